@@ -0,0 +1,53 @@
+/*
+  BootServices.h - flash routines of the audio bootloader for the application
+
+  Only available if the bootloader was built with SERVICES=1. The routines are
+  reached through a jump table in the last words of flash, so an application can
+  log into spare flash pages without carrying its own SPM code:
+
+      #include "BootServices.h"
+
+      uint8_t data[ SPM_PAGESIZE ];
+      ...
+      boot_service_page_erase( LOGPAGE );
+      boot_service_page_fill_write( LOGPAGE, data );
+
+  A page that is only written after the erase can be written again with bits cleared,
+  without erasing it first: fill the buffer with 0xFF except for the new entries.
+  Page 0, the last application page (it holds the application vector) and the
+  bootloader are refused, erase and write return 0 then.
+  Erase and write take about 4.5ms each, interrupts are disabled meanwhile.
+
+  Any EEPROM write clears the temporary page buffer. boot_service_page_fill_write()
+  fills and writes with interrupts disabled throughout. Between the separate
+  boot_service_page_fill() and boot_service_page_write() interrupts run, so call
+  EEPROMAsync.flush() before the fill and write no EEPROM cell until the page write.
+*/
+
+#ifndef BootServices_h
+#define BootServices_h
+
+#include <inttypes.h>
+
+#define BOOTSERVICES_END    0x2000  // end of flash, the table grows downwards
+
+// word address of service n, as needed by a function pointer
+#define BOOTSERVICE(n)      ((BOOTSERVICES_END - 2 * ((n) + 1)) / 2)
+
+// erase the flash page containing address
+#define boot_service_page_erase(address)    ((uint8_t (*)(uint16_t)) BOOTSERVICE(0))(address)
+
+// write the temporary page buffer to the page containing address
+#define boot_service_page_write(address)    ((uint8_t (*)(uint16_t)) BOOTSERVICE(1))(address)
+
+// fill the temporary page buffer with SPM_PAGESIZE bytes from buf
+#define boot_service_page_fill(address, buf) ((void (*)(uint16_t, const uint8_t *)) BOOTSERVICE(2))(address, buf)
+
+// CRC-16/CCITT (reflected, start value 0xFFFF) of length flash bytes, as _crc_ccitt_update
+#define boot_service_flash_crc(address, length) ((uint16_t (*)(uint16_t, uint16_t)) BOOTSERVICE(3))(address, length)
+
+// fill the temporary page buffer with SPM_PAGESIZE bytes from buf and write it to the page
+// containing address, safe against EEPROM writes from interrupts
+#define boot_service_page_fill_write(address, buf) ((uint8_t (*)(uint16_t, const uint8_t *)) BOOTSERVICE(4))(address, buf)
+
+#endif
@@ -22,6 +22,7 @@
 #define EEPROM_h
 
 #include <inttypes.h>
+#include <stddef.h>
 #include <avr/eeprom.h>
 #include <avr/io.h>
 
@@ -126,21 +127,429 @@ struct EEPROMClass{
     EEPtr end()                          { return length(); } //Standards requires this to be the item after the last valid entry. The returned pointer is invalid.
     uint16_t length()                    { return E2END + 1; }
     
-    //Functionality to 'get' and 'put' objects to and from EEPROM.
+    //Functionality to 'get' and 'put' objects to and from EEPROM, as one block transfer.
     template< typename T > T &get( int idx, T &t ){
-        EEPtr e = idx;
-        uint8_t *ptr = (uint8_t*) &t;
-        for( int count = sizeof(T) ; count ; --count, ++e )  *ptr++ = *e;
+        eeprom_read_block( &t, (const void*) idx, sizeof(T) );
         return t;
     }
     
     template< typename T > const T &put( int idx, const T &t ){
-        EEPtr e = idx;
-        const uint8_t *ptr = (const uint8_t*) &t;
-        for( int count = sizeof(T) ; count ; --count, ++e )  (*e).update( *ptr++ );
+        eeprom_update_block( &t, (void*) idx, sizeof(T) );
         return t;
     }
 };
 
 static EEPROMClass EEPROM;
+
+/***
+    EELayout and EEField classes.
+    
+    Describe the EEPROM contents as a struct instead of hard coded offsets. EELayout places
+    the struct at Base and checks at compile time that it fits, EEFIELD gives the type of
+    one member with its EEPROM address computed at compile time. Fields are read and written
+    as one block, put() only writes the bytes that changed.
+    
+        struct Settings{ uint8_t volume; int16_t tune; uint8_t name[ 8 ]; };
+        typedef EELayout< Settings, 16 > SettingsLayout;
+        
+        EEFIELD( SettingsLayout, tune ) tune;
+        tune = 440;
+        int16_t t;
+        tune.get( t );
+***/
+
+template< typename T, int Offset > struct EEField{
+
+    typedef T Type;
+    enum{ Address = Offset, Size = sizeof(T) };
+    
+    static_assert( Offset >= 0 && Offset + sizeof(T) <= E2END + 1, "EEField does not fit into the EEPROM" );
+
+    static T &get( T &t )                { return eeprom_read_block( &t, (const void*) Offset, sizeof(T) ), t; }
+    static const T &put( const T &t )    { return eeprom_update_block( &t, (void*) Offset, sizeof(T) ), t; }
+    const EEField &operator=( const T &t ) const { return put( t ), *this; }
+};
+
+template< typename S, int Base = 0 > struct EELayout : EEField< S, Base >{
+
+    typedef S Struct;
+    enum{ Start = Base, End = Base + sizeof(S) }; //End is the first cell after the layout.
+};
+
+#define EEFIELD( layout, member ) \
+    EEField< decltype( ( (layout::Struct*) 0 )->member ), layout::Start + offsetof( layout::Struct, member ) >
+
+/***
+    EEPROMLog class.
+    
+    Wear leveled store for values that change often. Instead of fixed cells each put()
+    appends a record to a ring of slots in Start ... Start + Size - 1, so writes are spread
+    over the whole area. Every slot holds one record:
+    
+        [ seq ][ key ][ value, ValueSize bytes ][ check ]
+    
+    seq counts up by one per record, the newest record is the one after which the sequence
+    breaks. begin() reads every slot once and remembers the newest slot of every key, after
+    that get() reads the value directly. When the slot to be written still holds the newest
+    record of another key, that record is written again with a new seq and the next slot is
+    taken, so there must be more slots than keys.
+    
+    Cost with Size 512 and ValueSize 4 (73 slots): begin() reads Slots * RecordSize = 511
+    cells, each once. put() writes ValueSize + 3 cells at 3.4ms each, unchanged cells are
+    skipped, plus one record for every live record of another key in the way.
+    
+        EEPROMLog< 0, 512, 2, 4 > store;    //2 keys, 4 byte values
+        store.begin();
+        store.put( 0, preset );
+        store.get( 0, preset );
+***/
+
+template< int Start, int Size, uint8_t Keys, uint8_t ValueSize > struct EEPROMLog{
+
+    enum{ RecordSize = ValueSize + 3, Slots = Size / RecordSize, NoSlot = 0xFF };
+    
+    static_assert( Start >= 0 && Start + Size <= E2END + 1, "EEPROMLog area is outside the EEPROM" );
+    static_assert( Slots > Keys && Slots < NoSlot, "EEPROMLog needs more slots than keys and at most 254 slots" );
+    static_assert( Keys < 0xFF, "EEPROMLog key 0xFF marks an erased slot" );
+
+    //Scan the area and build the index in one pass, every slot is read once. The head is
+    //the valid slot whose successor breaks the sequence, slot 0 is taken again at the end
+    //as successor of the last slot. Slots up to the head hold the newest records, those
+    //after it the oldest, so a key found up to the head wins over one found after it.
+    void begin(){
+        uint8_t older[ Keys ];              //newest slot of each key after the head
+        uint8_t n, s = 0, key = 0, prevSeq = 0, firstSeq = 0;
+        bool v, prevValid = false, firstValid = false, found = false;
+        
+        head = Slots - 1;
+        seq = 0xFF;
+        for( n = 0 ; n < Keys ; ++n ) index[ n ] = older[ n ] = NoSlot;
+        for( n = 0 ; n <= Slots ; ++n ){
+            if( n < Slots ){
+                v = read( n, s, key );
+            }else{
+                v = firstValid;
+                s = firstSeq;
+            }
+            if( !n ){
+                firstValid = v;
+                firstSeq = s;
+            }else if( !found && prevValid && ( !v || s != (uint8_t)( prevSeq + 1 ) ) ){
+                found = true;
+                head = n - 1;
+                seq = prevSeq;
+            }
+            if( v && n < Slots ) ( found ? older : index )[ key ] = n;
+            prevValid = v;
+            prevSeq = s;
+        }
+        for( n = 0 ; n < Keys ; ++n ) if( index[ n ] == NoSlot ) index[ n ] = older[ n ];
+    }
+    
+    bool has( uint8_t key )              { return index[ key ] != NoSlot; }
+    
+    //Read the newest value of key, t is left unchanged if the key was never written.
+    template< typename T > T &get( uint8_t key, T &t ){
+        static_assert( sizeof(T) <= ValueSize, "EEPROMLog value is larger than ValueSize" );
+        if( has( key ) ){
+            EEPtr e = address( index[ key ] ) + 2;
+            uint8_t *ptr = (uint8_t*) &t;
+            for( int count = sizeof(T) ; count ; --count, ++e )  *ptr++ = *e;
+        }
+        return t;
+    }
+    
+    template< typename T > const T &put( uint8_t key, const T &t ){
+        static_assert( sizeof(T) <= ValueSize, "EEPROMLog value is larger than ValueSize" );
+        uint8_t value[ ValueSize ] = { 0 };
+        const uint8_t *ptr = (const uint8_t*) &t;
+        for( uint8_t i = 0 ; i < sizeof(T) ; ++i )  value[ i ] = ptr[ i ];
+        
+        uint8_t n = next( head );
+        uint8_t live;
+        while( ( live = owner( n ) ) != NoSlot && live != key ){ //keep the other key alive
+            uint8_t old[ ValueSize ];
+            for( uint8_t i = 0 ; i < ValueSize ; ++i )  old[ i ] = *EEPtr( address( n ) + 2 + i );
+            append( n, live, old );
+            n = next( n );
+        }
+        append( n, key, value );
+        return t;
+    }
+    
+    //The record is written seq last, a write that is cut off leaves a record that fails the check.
+    void append( uint8_t n, uint8_t key, const uint8_t *value ){
+        uint8_t s = seq + 1;
+        uint8_t check = checksum( s, key, value );
+        int a = address( n );
+        for( uint8_t i = 0 ; i < ValueSize ; ++i )  EERef( a + 2 + i ).update( value[ i ] );
+        EERef( a + 1 ).update( key );
+        EERef( a + RecordSize - 1 ).update( check );
+        EERef( a ).update( s );
+        seq = s;
+        head = n;
+        index[ key ] = n;
+    }
+    
+    //Read seq and key of slot n, reading each cell once, true if the record is valid.
+    bool read( uint8_t n, uint8_t &s, uint8_t &key ){
+        int a = address( n );
+        s = *EEPtr( a );
+        key = *EEPtr( a + 1 );
+        if( key >= Keys ) return false;
+        uint8_t value[ ValueSize ];
+        for( uint8_t i = 0 ; i < ValueSize ; ++i )  value[ i ] = *EEPtr( a + 2 + i );
+        return checksum( s, key, value ) == *EEPtr( a + RecordSize - 1 );
+    }
+    
+    uint8_t owner( uint8_t n ){
+        for( uint8_t key = 0 ; key < Keys ; ++key )  if( index[ key ] == n ) return key;
+        return NoSlot;
+    }
+    
+    static uint8_t checksum( uint8_t s, uint8_t key, const uint8_t *value ){
+        uint8_t sum = s ^ 0xA5;
+        sum = ( sum << 1 | sum >> 7 ) + key;
+        for( uint8_t i = 0 ; i < ValueSize ; ++i )  sum = ( sum << 1 | sum >> 7 ) + value[ i ];
+        return sum;
+    }
+    
+    static uint8_t next( uint8_t n )     { return n + 1 < Slots ? n + 1 : 0; }
+    static int address( uint8_t n )      { return Start + n * RecordSize; }
+    
+    uint8_t index[ Keys ];  //newest slot of each key
+    uint8_t head;           //slot of the newest record
+    uint8_t seq;            //its sequence number
+};
+
+#ifdef EEPROM_ASYNC_SIZE
+#include <avr/interrupt.h>
+
+/***
+    EEPROMAsyncClass class.
+    
+    Writes without waiting: write() only queues the cell and the EE_RDY interrupt writes
+    one queued cell each time the EEPROM is ready, so a write costs a few microseconds
+    instead of 3.4ms. Enable it by defining the queue size before the include, in one
+    source file only since this also defines the interrupt routine:
+    
+        #define EEPROM_ASYNC_SIZE 16
+        #include "EEPROM.h"
+    
+    Full queue policy: a cell that is already queued is overwritten in place and never
+    needs a new slot, otherwise write() returns false and nothing is queued and the caller
+    can retry later. Call flush() before writing through EEPROM directly.
+    read() waits if the cell is not queued and a write is still running.
+***/
+
+#if EEPROM_ASYNC_SIZE < 1 || EEPROM_ASYNC_SIZE > 255
+#error "EEPROM_ASYNC_SIZE must be 1 ... 255"
+#endif
+
+struct EEPROMAsyncClass{
+
+    //Queue a cell, false if the queue is full.
+    bool write( int idx, uint8_t val ){
+        bool queued = true;
+        uint8_t sreg = SREG;
+        cli();
+        uint8_t n = find( idx );
+        if( n < count ){
+            data[ slot( n ) ] = val;
+        }else if( count < EEPROM_ASYNC_SIZE ){
+            uint8_t i = slot( count++ );
+            address[ i ] = idx;
+            data[ i ] = val;
+            EECR |= ( 1 << EERIE ); //the interrupt fires as soon as EEPE is clear
+        }else{
+            queued = false;
+        }
+        SREG = sreg;
+        return queued;
+    }
+    
+    //The value the cell will have, including queued writes.
+    uint8_t read( int idx ){
+        uint8_t sreg = SREG;
+        cli();
+        uint8_t n = find( idx );
+        bool queued = n < count;            //count may drop as soon as SREG is back
+        uint8_t val = queued ? data[ slot( n ) ] : 0;
+        SREG = sreg;
+        if( queued ) return val;
+
+        //service() must not move EEAR between the address and EERE.
+        EECR &= ~( 1 << EERIE );
+        while( EECR & ( 1 << EEPE ) );
+        EEAR = idx;
+        EECR |= ( 1 << EERE );
+        val = EEDR;
+        if( count ) EECR |= ( 1 << EERIE );
+        return val;
+    }
+    
+    uint8_t pending()                    { return count; } //Number of queued cells.
+    bool idle()                          { return !count && !( EECR & ( 1 << EEPE ) ); }
+    void flush()                         { while( !idle() ); }
+    
+    //Called from the EE_RDY interrupt: start writing the oldest queued cell.
+    void service(){
+        while( count ){
+            uint16_t idx = address[ head ];
+            uint8_t val = data[ head ];
+            if( ++head == EEPROM_ASYNC_SIZE ) head = 0;
+            --count;
+            if( eeprom_read_byte( (uint8_t*) idx ) != val ){
+                EEAR = idx;
+                EEDR = val;
+                EECR = ( 1 << EERIE ) | ( 1 << EEMPE ); //atomic erase and write
+                EECR |= ( 1 << EEPE );
+                return;
+            }
+        }
+        EECR &= ~( 1 << EERIE );
+    }
+    
+    uint8_t slot( uint8_t n )            { n += head; return n >= EEPROM_ASYNC_SIZE ? n - EEPROM_ASYNC_SIZE : n; }
+    uint8_t find( int idx ){
+        uint8_t n = 0;
+        while( n < count && address[ slot( n ) ] != idx ) ++n;
+        return n;
+    }
+    
+    uint16_t address[ EEPROM_ASYNC_SIZE ];
+    uint8_t data[ EEPROM_ASYNC_SIZE ];
+    volatile uint8_t head;
+    volatile uint8_t count;
+};
+
+static EEPROMAsyncClass EEPROMAsync;
+
+ISR( EE_RDY_vect ){
+    EEPROMAsync.service();
+}
+#endif
+
+/***
+    EECacheRef class.
+    
+    The EERef of an EEPROMCache: reads come from RAM and writes only mark the cell dirty,
+    so compound operators like += no longer wait for the EEPROM.
+***/
+
+template< typename Cache > struct EECacheRef{
+
+    EECacheRef( Cache &cache, const int index )
+        : cache( cache ), index( index )      {}
+    
+    //Access/read members.
+    uint8_t operator*() const                 { return cache.read( index ); }
+    operator const uint8_t() const            { return **this; }
+    
+    //Assignment/write members.
+    EECacheRef &operator=( const EECacheRef &ref ) { return *this = *ref; }
+    EECacheRef &operator=( uint8_t in )       { return cache.write( index, in ), *this;  }
+    EECacheRef &operator +=( uint8_t in )     { return *this = **this + in; }
+    EECacheRef &operator -=( uint8_t in )     { return *this = **this - in; }
+    EECacheRef &operator *=( uint8_t in )     { return *this = **this * in; }
+    EECacheRef &operator /=( uint8_t in )     { return *this = **this / in; }
+    EECacheRef &operator ^=( uint8_t in )     { return *this = **this ^ in; }
+    EECacheRef &operator %=( uint8_t in )     { return *this = **this % in; }
+    EECacheRef &operator &=( uint8_t in )     { return *this = **this & in; }
+    EECacheRef &operator |=( uint8_t in )     { return *this = **this | in; }
+    EECacheRef &operator <<=( uint8_t in )    { return *this = **this << in; }
+    EECacheRef &operator >>=( uint8_t in )    { return *this = **this >> in; }
+    
+    EECacheRef &update( uint8_t in )          { return *this = in; } //write() already ignores unchanged values.
+    
+    /** Prefix increment/decrement **/
+    EECacheRef& operator++()                  { return *this += 1; }
+    EECacheRef& operator--()                  { return *this -= 1; }
+    
+    /** Postfix increment/decrement **/
+    uint8_t operator++ (int){ 
+        uint8_t ret = **this;
+        return ++(*this), ret;
+    }
+
+    uint8_t operator-- (int){ 
+        uint8_t ret = **this;
+        return --(*this), ret;
+    }
+    
+    Cache &cache;
+    int index; //EEPROM address of the cell.
+};
+
+/***
+    EEPROMCache class.
+    
+    Opt-in RAM copy of the EEPROM cells Start ... Start + Size - 1, indexed by their
+    EEPROM address just like EEPROMClass. Changed cells are recorded in a bitmap and
+    only written by commit(), so the EEPROM is never touched in between.
+    The window costs Size + Size / 8 bytes of RAM.
+    
+        EEPROMCache< 0, 32 > settings;
+        settings.begin();                   //load the window
+        settings[ 3 ] += 1;
+        settings.put( 4, value );
+        settings.commit();                  //write the changed cells
+***/
+
+template< int Start, int Size > struct EEPROMCache{
+
+    static_assert( Start >= 0 && Start + Size <= E2END + 1, "EEPROMCache window is outside the EEPROM" );
+
+    typedef EECacheRef< EEPROMCache > Ref;
+
+    //Load the window and forget pending changes.
+    void begin(){
+        eeprom_read_block( data, (const void*) Start, Size );
+        for( int i = 0 ; i < (int) sizeof(dirtyMap) ; ++i )  dirtyMap[ i ] = 0;
+    }
+
+    //Basic user access methods, idx is the EEPROM address.
+    Ref operator[]( const int idx )          { return Ref( *this, idx ); }
+    uint8_t read( int idx )                  { return data[ idx - Start ]; }
+    void write( int idx, uint8_t val ){
+        idx -= Start;
+        if( data[ idx ] != val ){
+            data[ idx ] = val;
+            dirtyMap[ idx >> 3 ] |= 1 << ( idx & 7 );
+        }
+    }
+    void update( int idx, uint8_t val )      { write( idx, val ); }
+    
+    uint16_t length()                        { return Size; }
+
+    //Functionality to 'get' and 'put' objects to and from the cache.
+    template< typename T > T &get( int idx, T &t ){
+        uint8_t *ptr = (uint8_t*) &t;
+        for( int count = sizeof(T) ; count ; --count, ++idx )  *ptr++ = read( idx );
+        return t;
+    }
+    
+    template< typename T > const T &put( int idx, const T &t ){
+        const uint8_t *ptr = (const uint8_t*) &t;
+        for( int count = sizeof(T) ; count ; --count, ++idx )  write( idx, *ptr++ );
+        return t;
+    }
+
+    //True if there are changes that have not been committed.
+    bool dirty(){
+        for( int i = 0 ; i < (int) sizeof(dirtyMap) ; ++i )  if( dirtyMap[ i ] ) return true;
+        return false;
+    }
+
+    //Write all changed cells to the EEPROM. This blocks for about 3.4ms per changed cell.
+    void commit(){
+        for( int i = 0 ; i < Size ; ++i ){
+            if( dirtyMap[ i >> 3 ] & ( 1 << ( i & 7 ) ) )  eeprom_update_byte( (uint8_t*) ( Start + i ), data[ i ] );
+        }
+        for( int i = 0 ; i < (int) sizeof(dirtyMap) ; ++i )  dirtyMap[ i ] = 0;
+    }
+
+    uint8_t data[ Size ];
+    uint8_t dirtyMap[ ( Size + 7 ) / 8 ];
+};
 #endif
\ No newline at end of file
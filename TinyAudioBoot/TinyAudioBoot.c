@@ -148,15 +148,29 @@
 #include <avr/boot.h>
 #include <avr/pgmspace.h>
 #include <avr/eeprom.h>
+#include <util/crc16.h>
 
 // Configuration options
 #define WONKYSTUFF  (1)
 #define USELED      (1)
+// #define COMPRESSION         // accept LZSS compressed program frames (make COMPRESS=1)
+// #define FEC                 // frames carry a SECDED code, single bit errors are corrected (make FEC=1)
+// #define INTERLEAVE  4       // bits of 4 frames are interleaved, needs FEC (make FEC=1 INTERLEAVE=4)
+// #define SERVICES            // flash routines for the application, see BootServices.h (make SERVICES=1)
+// #define ZEROCOPY            // program frames go into the page buffer while they are received (make ZEROCOPY=1)
+// #define ACOMP               // the analog comparator decides the input level, see below (make ACOMP=1)
+// #define ADCSLICER           // the ADC samples the input, sliced at the middle of its swing (make ADCSLICER=1)
+// #define PAM                 // 4 level symbols, 2 bits each, needs ADCSLICER (make ADCSLICER=1 PAM=1)
+// #define ASMRX               // the bits are received by an assembler loop with a fixed cycle count (make ASMRX=1)
+// #define MILLER              // Miller coded frames are received too, told apart by their start bit (make MILLER=1)
+// #define RATEFIELD           // frames carry their bit rate, frames above RX_MAX_BITRATE are skipped (make RATEFIELD=1)
 
 // This value has to be adapted to the bootloader size
-// If you change this, please change BOOTLOADER_ADDRESS on Makefile too
+// The Makefile passes its own BOOTLOADER_ADDRESS, this default is used by the Arduino IDE build
 
+#ifndef BOOTLOADER_ADDRESS
 #define BOOTLOADER_ADDRESS     0x1BC0               // bootloader start address, e.g. 0x1C00 = 7168, set .text to 0x0E00
+#endif
 
 #define RJMP                   (0xC000U - 1)        // opcode of RJMP minus offset 1
 #define RESET_SECTION          __attribute__((section(".bootreset"))) __attribute__((used))
@@ -197,17 +211,103 @@ uint16_t resetVector RESET_SECTION = RJMP + BOOTLOADER_ADDRESS / 2;
 #endif
 
 #define INITBOOTCHECK() {DDRB &= ~BOOTCHECKPIN; PORTB |= BOOTCHECKPIN; } // boot-check pin is input
+#ifdef MMO
+#define BOOTBUTTONPRESSED()  (PINB & BOOTCHECKPIN)
+#else
+#define BOOTBUTTONPRESSED()  (!(PINB & BOOTCHECKPIN))
+#endif
+
+// the button has to be held this long after reset to enter the bootloader
+#ifndef BOOTENTRY_MS
+#define BOOTENTRY_MS        3000
+#endif
+// timer 0 overflows every 256 * 8 clocks (128us @16MHz)
+#define BOOTENTRY_OVERFLOWS ((uint16_t)((BOOTENTRY_MS * (F_CPU / 1000UL)) / (256UL * 8)))
 #else
 #define INITBOOTCHECK()
 #endif
 
 #ifdef MMO
 #define INPUTAUDIOPIN   (1u << PB2) // PB2 is ATTiny85 pin 7
+#define AUDIOADCCHANNEL 1           // PB2 is ADC1
 #else
 #define INPUTAUDIOPIN   (1u << PB3) // PB3 is ATTiny85 pin 2
+#define AUDIOADCCHANNEL 3           // PB3 is ADC3
+#endif
+
+#ifdef ACOMP
+// The analog comparator compares the audio pin against the 1.1V bandgap instead of
+// relying on the input threshold of the pin, which differs from chip to chip.
+// The pin is reached through the ADC multiplexer (ACME set, ADC off), so both pin
+// maps stay as they are; AIN0/AIN1 are taken by the boot check and the LED.
+// The voltage divider has to bias the pin near 1.1V instead of VCC/2, e.g. 10K to VCC
+// and 2.7K to GND at 5V. The comparator interrupt can't be used, the vector table
+// belongs to the application, so ACO is polled like the pin.
+#define PINVALUE        (ACSR & _BV(ACO))
+#define INITAUDIOPORT() { DDRB &= ~INPUTAUDIOPIN;   /* audio pin is input                   */ \
+                          DIDR0 = INPUTAUDIOPIN;    /* no digital input buffer on the pin   */ \
+                          ADCSRB = _BV(ACME);       /* negative input from the multiplexer */ \
+                          ADMUX = AUDIOADCCHANNEL;                                                 \
+                          ACSR = _BV(ACBG); }       /* positive input is the bandgap        */
+#elif defined(ADCSLICER)
+// The ADC converts the audio pin continuously with 8 bits, the level is decided in
+// software: the highest and lowest recent samples are tracked and the input is
+// sliced at their middle with 1/8 of the swing as hysteresis. Volume and DC offset
+// don't matter as long as the swing reaches ADCSLICER_MINSWING, below that (silence)
+// the level is held. Highest and lowest move towards each other by one step every
+// 8 conversions, so the slicer follows a falling volume.
+//
+// With the ADC clock at F_CPU/16 (1MHz at 16MHz, fine for 8 bits) a conversion takes
+// 13us, 77k samples per second. An edge is seen up to one conversion late, this has to
+// stay well inside the quarter bit the receiver allows: at the full speed of 11025 bit/s
+// a quarter bit is 22.7us. So about 19 kbit/s is the limit, where the digital pin is
+// seen within a microsecond and only the 8 bit timer limits the rate.
+#ifndef ADCSLICER_MINSWING
+#define ADCSLICER_MINSWING  8   // ADC steps, about 160mV at 5V
 #endif
+#define PINVALUE        adc_slice()
+#define INITAUDIOPORT() { DDRB &= ~INPUTAUDIOPIN;   /* audio pin is input                   */ \
+                          DIDR0 = INPUTAUDIOPIN;    /* no digital input buffer on the pin   */ \
+                          ADMUX = _BV(ADLAR) | AUDIOADCCHANNEL; /* VCC reference, 8 bits in ADCH */ \
+                          ADCSRB = 0;               /* free running                         */ \
+                          ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADATE) | _BV(ADPS2); } /* clk/16 */
+
+uint8_t adcHigh;
+uint8_t adcLow = 0xFF;
+uint8_t adcLevel;
+uint8_t adcConversions;
+
+static uint8_t
+adc_slice(void)
+{
+    if (ADCSRA & _BV(ADIF))     // a new sample
+    {
+        uint8_t v = ADCH;
+
+        ADCSRA |= _BV(ADIF);    // cleared by writing a one
+        if (v > adcHigh) adcHigh = v;
+        if (v < adcLow)  adcLow = v;
+        if ((++adcConversions & 7) == 0 && adcHigh > adcLow)
+        {
+            adcHigh--;
+            adcLow++;
+        }
+
+        uint8_t swing = adcHigh - adcLow;
+        if (adcHigh >= adcLow && swing >= ADCSLICER_MINSWING)
+        {
+            uint8_t middle = adcLow + swing / 2;
+
+            if (v > middle + swing / 8)      adcLevel = INPUTAUDIOPIN;
+            else if (v < middle - swing / 8) adcLevel = 0;
+        }
+    }
+    return adcLevel;
+}
+#else
 #define PINVALUE        (PINB & INPUTAUDIOPIN)
 #define INITAUDIOPORT() {DDRB &= ~INPUTAUDIOPIN;} // audio pin is input
+#endif
 
 #define WAITBLINKTIME   10000
 #define BOOT_TIMEOUT    10
@@ -231,7 +331,13 @@ uint16_t resetVector RESET_SECTION = RJMP + BOOTLOADER_ADDRESS / 2;
 #define CRCHIGH         6u  // checksum higher part
 #define DATAPAGESTART   7u  // start of data
 #define PAGESIZE        SPM_PAGESIZE
+#ifdef FEC
+#define FECLOW          (PAGESIZE+DATAPAGESTART) // check bits 0..7
+#define FECHIGH         (FECLOW+1)               // check bits 8..9, overall parity in bit 7
+#define FRAMESIZE       (FECHIGH+1)              // size of the data block to be received
+#else
 #define FRAMESIZE       (PAGESIZE+DATAPAGESTART) // size of the data block to be received
+#endif
 
 // bootloader commands
 #define NOCOMMAND       0u
@@ -240,8 +346,54 @@ uint16_t resetVector RESET_SECTION = RJMP + BOOTLOADER_ADDRESS / 2;
 #define RUNCOMMAND      3u
 #define EEPROMCOMMAND   4u
 #define EXITCOMMAND     5u
+#define LZSSCOMMAND     6u  // LENGTHLOW holds the number of compressed bytes in the frame
+#define ERASECOMMAND    7u  // header only: erase LENGTHLOW pages starting at the page index
+#define CHIPERASECOMMAND 8u // header only: erase all application pages but page 0
+#ifdef RATEFIELD
+#define COMMANDMASK     0x0Fu // the high nibble holds the bit rate, see rate_check()
+#else
+#define COMMANDMASK     0xFFu
+#endif
+
+#if defined(ACOMP) && defined(ADCSLICER)
+#error "ACOMP and ADCSLICER are two different input stages, choose one"
+#endif
+
+#if defined(PAM) && (!defined(ADCSLICER) || defined(INTERLEAVE) || defined(ZEROCOPY))
+#error "PAM needs ADCSLICER and can't be used with INTERLEAVE or ZEROCOPY"
+#endif
+
+#if defined(ASMRX) && (defined(ACOMP) || defined(ADCSLICER) || defined(INTERLEAVE))
+#error "ASMRX reads the digital pin and can't be used with ACOMP, ADCSLICER, PAM or INTERLEAVE"
+#endif
 
-uint8_t FrameData[ FRAMESIZE ];
+#if defined(MILLER) && defined(INTERLEAVE)
+#error "MILLER can't be used with INTERLEAVE"
+#endif
+
+#if defined(RATEFIELD) && defined(MILLER)
+#error "RATEFIELD can't be used with MILLER: the Miller preamble runs at twice the bit rate"
+#endif
+
+#if defined(ZEROCOPY) && defined(FEC)
+#error "ZEROCOPY can't be used with FEC: a frame has to be corrected before it goes into the page buffer"
+#endif
+
+#ifdef INTERLEAVE
+#ifndef FEC
+#error "INTERLEAVE needs FEC"
+#endif
+#define FRAMEGROUP      INTERLEAVE  // number of frames received as one interleaved block
+#else
+#define FRAMEGROUP      1u
+#endif
+
+uint8_t FrameData[ FRAMEGROUP * FRAMESIZE ];
+
+#ifdef COMPRESSION
+uint8_t  PageBuffer[ PAGESIZE ];  // page currently being decompressed
+uint16_t lzssAddress;             // flash address of the next decompressed byte
+#endif
 
 #define FLASH_RESET_ADDR        0x0000                // address of reset vector (in bytes)
 #define BOOTLOADER_STARTADDRESS BOOTLOADER_ADDRESS    // start address:
@@ -256,6 +408,7 @@ uint8_t FrameData[ FRAMESIZE ];
 #endif
 
 void (*start_appl_main) (void);
+uint8_t flashErased;    // set by the CHIPERASECOMMAND: program frames only need a page write
 
 #define BOOTLOADER_FUNC_ADDRESS (BOOTLOADER_STARTADDRESS - sizeof (start_appl_main))
 
@@ -267,20 +420,35 @@ void (*start_appl_main) (void);
 //AVR ATtiny85 Programming: EEPROM Reading and Writing - YouTube
 //https://www.youtube.com/watch?v=DO-D6YmRpJk
 
+// The cell is read first: unchanged bytes are skipped, and if the new value only
+// clears bits (write only) or is 0xFF (erase only) half a programming cycle is
+// enough, 1.8ms instead of 3.4ms.
 void
 eeprom_write(uint16_t address, uint8_t data)
 {
+    uint8_t old;
+
     while(EECR & (1<<EEPE));
 
-    EECR = (0<<EEPM1) | (0<<EEPM0);
+    if (address > E2END) return;
+
+    EEAR = address;
+    EECR |= (1<<EERE);
+    old = EEDR;
 
-    if (address < 512)
+    if (old == data) return;
+
+    if (data == 0xFF)
+    {
+        EECR = (0<<EEPM1) | (1<<EEPM0);     // erase only
+    }
+    else if ((old & data) == data)
     {
-        EEAR = address;
+        EECR = (1<<EEPM1) | (0<<EEPM0);     // write only
     }
     else
     {
-        EEAR = 511;
+        EECR = (0<<EEPM1) | (0<<EEPM0);     // erase and write
     }
 
     EEDR = data;
@@ -290,33 +458,271 @@ eeprom_write(uint16_t address, uint8_t data)
 }
 
 //***************************************************************************************
-// receiveFrame()
+// EEPROM write queue
 //
-// This routine receives a differential manchester coded signal at the input pin.
-// The routine waits for a toggling voltage level.
-// It automatically detects the transmission speed.
+// An EEPROM frame is copied into EepromQueue and written one byte at a time whenever the
+// EEPROM is ready, while the bootloader goes on receiving the next frame. The EE_RDY
+// interrupt can't be used for this: the vector table belongs to the application.
 //
-// output:    uint8_t flag:     true: checksum OK
-//            uint8_t FramData: global data buffer
+// eeprom_service() runs at the byte boundaries of the receive loop. There only the
+// quarter bit between the sample and the next edge is left for all per-byte work:
+// about 363 cycles at 11025 bit/s and 16MHz. ASMRX moves it behind the next edge, see rx_byte().
 //
 //***************************************************************************************
-uint8_t
-receiveFrame(void)
+uint8_t  EepromQueue[ PAGESIZE ];
+uint16_t eepromQueueAddress;        // EEPROM address of the next byte
+uint8_t  eepromQueueHead;           // next byte to write
+uint8_t  eepromQueueEnd;
+
+static void
+eeprom_service(void)
 {
-    uint16_t counter = 0;
-    volatile uint16_t time = 0;
-    volatile uint16_t delayTime;
-    uint8_t p, t;
-    uint8_t k = 8;
-    uint8_t dataPointer = 0;
+    if (eepromQueueHead < eepromQueueEnd && !(EECR & (1<<EEPE)))
+    {
+        eeprom_write(eepromQueueAddress++, EepromQueue[eepromQueueHead++]);
+    }
+}
+
+static void
+eeprom_flush(void)
+{
+    while (eepromQueueHead < eepromQueueEnd)
+    {
+        eeprom_service();
+    }
+}
+
+#ifdef FEC
+//***************************************************************************************
+// fec_syndrome()
+//
+// Extended Hamming code over header and data. The data bits are numbered in receive
+// order starting at 3, skipping the powers of two which belong to the check bits.
+// The syndrome is the XOR of the numbers of all set bits, bit 15 collects their parity.
+// The bit numbered 'flip' is inverted on the way.
+//
+//***************************************************************************************
+static uint16_t
+fec_syndrome(uint8_t *frame, uint16_t flip)
+{
+    uint16_t syndrome = 0;
+    uint16_t position = 2;
+    uint8_t *end = frame + FECLOW;
+    uint8_t mask;
+
+    for (; frame < end; frame++)
+    {
+        for (mask = 0x80; mask; mask >>= 1)
+        {
+            position++;
+            if (!(position & (position - 1))) position++;
+
+            if (position == flip) *frame ^= mask;
+            if (*frame & mask) syndrome ^= position | 0x8000;
+        }
+    }
+    return syndrome;
+}
+
+//***************************************************************************************
+// fec_correct()
+//
+// output:    uint8_t flag:     true: frame was error free or a single bit error was corrected
+//                              false: more than one bit error
+//
+//***************************************************************************************
+static uint8_t
+fec_correct(uint8_t *frame)
+{
+    uint16_t check = frame[FECLOW] | (((uint16_t)frame[FECHIGH]) << 8);
+    uint16_t syndrome = fec_syndrome(frame, 0) ^ (check & 0x83FF);
+
+    // the check bits take part in the overall parity
+    for (check &= 0x03FF; check; check &= check - 1) syndrome ^= 0x8000;
+
+    if (!(syndrome & 0x7FFF)) return true;          // no error or only the parity bit
+    if (!(syndrome & 0x8000)) return false;         // two bit errors
+    syndrome &= 0x7FFF;
+    if (!(syndrome & (syndrome - 1))) return true;  // error in a check bit
+
+    check = frame[FECLOW] | (((uint16_t)frame[FECHIGH]) << 8);
+    return !((fec_syndrome(frame, syndrome) ^ check) & 0x03FF);
+}
+#endif // FEC
+
+#ifdef PAM
+//***************************************************************************************
+// pamReceive()
+//
+// 4-PAM: every symbol carries two bits as one of four levels A, sent as +A for the
+// first and -A for the second half. So there is an edge in the middle of every symbol
+// to stay in sync with, and the difference d = a - b of the two halves, sampled by the
+// ADC a quarter symbol before and after that edge, is 2A free of any DC offset.
+//
+//      bits    10      11      01      00      (Gray code)
+//      A       +3      +1      -1      -3
+//
+// The preamble alternates +3 and -3, so its only edges are in the middle of the
+// symbols and receiveFrame() measures the symbol time from them. Meanwhile the size
+// of d is learned, the decision threshold between 1 and 3 is 2/3 of it, and the
+// middle edges of the data are found against the middle level of the preamble. Two symbols
+// of the same sign end the preamble, +3 +3 as sent: if they arrive negative the audio
+// line is inverted and a and b are swapped.
+//
+// input:     time: 8 symbol times in timer ticks
+//
+//***************************************************************************************
+static uint8_t
+pamReceive(uint16_t time)
+{
+    uint8_t quarterTime = time / 4 / 8;
+    uint8_t delayTime = time * 3 / 4 / 8;
+    uint8_t p, a = 0, b, middle;
+    uint8_t inverted, symbol;
+    int16_t d, last = 0, level = 0, threshold;
     uint16_t n;
 
-    //*** synchronisation and bit rate estimation **************************
-    time = 0;
-    // wait for edge
+    // we are at an edge, TIMER counts from it
+    for (n = 0; ; n++)
+    {
+        while (TIMER < quarterTime)
+            ;
+        b = ADCH;
+        d = a - b;
+
+        if (n > 0)
+        {
+            if (n > 1 && (d > 0) == (last > 0)) break;  // start marker
+            if (d < 0) d = -d;
+            level += (d - level) / 4;           // average of the last symbols
+        }
+        last = a - b;
+
+        while (TIMER < delayTime)
+            ;
+        a = ADCH;
+        p = PINVALUE;
+        while (p == PINVALUE)
+            ;
+        TIMER = 0;
+    }
+    inverted = (d < 0);
+    threshold = level / 2 + level / 8 + level / 32;
+    middle = adcLow + (adcHigh - adcLow) / 2;
+
+    for (n = 0; n < FRAMESIZE * 4; n++)
+    {
+        while (TIMER < delayTime)
+            ;
+        a = ADCH;
+
+        // the middle edge, without hysteresis: after a large symbol the first half
+        // of a small one may not have left the hysteresis of adc_slice() yet
+        if (a > middle)
+        {
+            while (ADCH > middle)
+                ;
+        }
+        else
+        {
+            while (ADCH <= middle)
+                ;
+        }
+        TIMER = 0;
+
+        while (TIMER < quarterTime)
+            ;
+        b = ADCH;
+        d = inverted ? b - a : a - b;
+
+        if (d > 0) symbol = (d > threshold)  ? 2 : 3;
+        else       symbol = (d > -threshold) ? 1 : 0;
+
+        FrameData[n / 4] = (FrameData[n / 4] << 2) | symbol;
+        if ((n & 3) == 3)
+        {
+            eeprom_service();
+#ifndef FEC
+            // erase frames carry no data
+            if (n == DATAPAGESTART * 4 - 1 && ((FrameData[COMMAND] & COMMANDMASK) == ERASECOMMAND || (FrameData[COMMAND] & COMMANDMASK) == CHIPERASECOMMAND)) break;
+#endif
+        }
+    }
+#ifdef FEC
+    return fec_correct(FrameData);
+#else
+    return true;
+#endif
+}
+#endif // PAM
+
+#ifndef RX_MAX_BITRATE
+#define RX_MAX_BITRATE      11025       // full speed: 44100 samples per second, 4 per bit
+#endif
+
+#ifdef RATEFIELD
+//***************************************************************************************
+// rate_check()
+//
+// The high nibble of the command byte holds the bit rate the frame was sent with, as
+// samples per bit at 44.1kHz times two: 8 for full speed, 6 to 10 from hex2wav -r.
+// Above 10 some edge intervals are 6 samples, longer than the 8 bit TIMER can measure.
+// 0 means no rate given. One step is half a sample, RATETICKS in 8 bit times.
+// A frame whose measured bit time is off by more than 1/8 was synchronised to something
+// else than its preamble and is rejected. The rate nibble is cleared in all frames of
+// the group, so the commands compare as usual.
+//
+// receiveFrame() skips frames faster than RX_MAX_BITRATE without decoding them, a WAV
+// with the program at several rates is received at the fastest rate this unit takes.
+//
+// output:    true: the rates of all frames are as measured or not given
+//
+//***************************************************************************************
+#define RATETICKS       (F_CPU / 88200)                                 // 181 at 16MHz
+#define RATEMINCODE     (88200 / RX_MAX_BITRATE)                        // 8 at 11025 bit/s
+#define RATEMINTIME     (RATEMINCODE * RATETICKS - RATETICKS / 2)       // halfway to the next faster code
+
+uint16_t frameTime;     // 8 bit times of the last frame in timer ticks
+
+static uint8_t
+rate_check(void)
+{
+    uint8_t *frame;
+    uint8_t ok = true;
+
+    for (frame = FrameData; frame < FrameData + FRAMEGROUP * FRAMESIZE; frame += FRAMESIZE)
+    {
+        uint16_t expected = (frame[COMMAND] >> 4) * RATETICKS;
+
+        frame[COMMAND] &= COMMANDMASK;
+        if (expected && (frameTime < expected - expected / 8 || frameTime > expected + expected / 8)) ok = false;
+    }
+    return ok;
+}
+#define RATECHECK()     rate_check()
+#else
+#define RATECHECK()     true
+#endif // RATEFIELD
+
+//***************************************************************************************
+// syncFrame()
+//
+// Wait for a frame and measure its bit rate from the edges of the preamble.
+//
+// input:     level: updated to the pin level after the last edge
+// output:    8 bit times in timer ticks, TIMER counts from the last edge
+//
+//***************************************************************************************
+static inline uint16_t
+syncFrame(uint8_t *level)
+{
+    uint16_t time = 0;
+    uint8_t p, t, n;
+
+    // wait for edge, the silence between frames is used for pending EEPROM writes
     p = PINVALUE;
     while (p == PINVALUE)
-        ;
+        eeprom_service();
 
     p = PINVALUE;
 
@@ -337,11 +743,312 @@ receiveFrame(void)
         }
     }
 
+    *level = p;
+    return time;
+}
+
+#ifdef ASMRX
+//***************************************************************************************
+// rx_byte()
+//
+// Receive the 8 bits of one manchester coded byte, the assembler version of the C loop below.
+// It is entered after the first edge of the byte, TIMER counting from it, and returns after
+// the first edge of the next byte. So the sample of the last bit and the next edge are only
+// separated by the instructions below, and the C code per byte in receiveFrame() (store,
+// EEPROM service, page fill) runs in the 3/4 bit before the first sample of the next byte.
+// Whether it finished in time is measured, not estimated: if TIMER has passed the sample
+// point on entry, late is set and receiveFrame() rejects the frame.
+// Cycles, counted from the instruction list below:
+//
+//      wait for edge       5 per check, the edge is seen up to 5 cycles late
+//      edge to TIMER = 0   2
+//      wait 3/4 bit        4 per check, the sample is taken up to 4 cycles late
+//      sample to next wait 9 on both paths of cpse / ori, 10 after the 8th bit
+//
+// So after the sample a bit needs at most 10 + 5 + 4 = 19 cycles before the next edge
+// may come. The build fails if that doesn't fit into the quarter bit at RX_MAX_BITRATE.
+//
+// input:     level: pin level after the first edge of the byte, updated
+//            delay: 3/4 bit in timer ticks
+//            last:  no byte follows, don't wait for its edge
+//            late:  set if the sample point had passed on entry
+//
+//***************************************************************************************
+#define RX_BIT_CYCLES       19
+#if RX_BIT_CYCLES * 4 > F_CPU / RX_MAX_BITRATE
+#error "ASMRX: the receive loop doesn't fit into a quarter bit at RX_MAX_BITRATE"
+#endif
+
+static inline uint8_t
+rx_byte(uint8_t *level, uint8_t delay, uint8_t last, uint8_t *late)
+{
+    uint8_t byte, t, count = 8, p = *level, l = *late;
+
+    asm volatile(
+        "in   %[t], %[timer]            \n\t"     //    the C code since the edge took too long
+        "cp   %[t], %[delay]            \n\t"
+        "brlo 2f                        \n\t"
+        "ldi  %[l], 1                   \n\t"
+        "rjmp 2f                        \n\t"
+        "1:                             \n\t"
+        "in   %[t], %[pin]              \n\t"     // 1  wait for edge
+        "andi %[t], %[mask]             \n\t"     // 1
+        "cp   %[t], %[p]                \n\t"     // 1
+        "breq 1b                        \n\t"     // 2, 1 at the edge
+        "out  %[timer], __zero_reg__    \n\t"     // 1  TIMER = 0
+        "mov  %[p], %[t]                \n\t"     // 1  level after the edge
+        "2:                             \n\t"
+        "in   %[t], %[timer]            \n\t"     // 1  delay 3/4 bit
+        "cp   %[t], %[delay]            \n\t"     // 1
+        "brlo 2b                        \n\t"     // 2, 1 when done
+        "in   %[t], %[pin]              \n\t"     // 1  sample
+        "andi %[t], %[mask]             \n\t"     // 1
+        "lsl  %[byte]                   \n\t"     // 1
+        "cpse %[t], %[p]                \n\t"     // 1, 2 if the level didn't change
+        "ori  %[byte], 1                \n\t"     // 1  changed: 1 bit
+        "mov  %[p], %[t]                \n\t"     // 1
+        "dec  %[count]                  \n\t"     // 1
+        "brne 1b                        \n\t"     // 2, 1 after the 8th bit
+        "cpse %[last], __zero_reg__     \n\t"     // 2, skips when a byte follows
+        "rjmp 4f                        \n\t"
+        "3:                             \n\t"
+        "in   %[t], %[pin]              \n\t"     // 1  wait for the first edge of the next byte
+        "andi %[t], %[mask]             \n\t"     // 1
+        "cp   %[t], %[p]                \n\t"     // 1
+        "breq 3b                        \n\t"     // 2, 1 at the edge
+        "out  %[timer], __zero_reg__    \n\t"     // 1  TIMER = 0
+        "mov  %[p], %[t]                \n\t"     // 1
+        "4:                             \n\t"
+        : [byte] "=&d" (byte), [t] "=&d" (t), [p] "+r" (p), [count] "+r" (count), [l] "+d" (l)
+        : [pin] "I" (_SFR_IO_ADDR(PINB)), [timer] "I" (_SFR_IO_ADDR(TCNT0)),
+          [mask] "M" (INPUTAUDIOPIN), [delay] "r" (delay), [last] "r" (last)
+    );
+    *level = p;
+    *late = l;
+    return byte;
+}
+#else
+//***************************************************************************************
+// rx_byte()
+//
+// Receive the 8 bits of one manchester coded byte.
+//
+// input:     level: pin level before the first bit, updated
+//            delay: 3/4 bit in timer ticks
+//
+//***************************************************************************************
+static inline uint8_t
+rx_byte(uint8_t *level, uint8_t delay)
+{
+    //the byte is assembled in a register: it starts as a single sentinel bit,
+    //which is shifted out by the 8th data bit, so no bit counter is needed
+    uint8_t byte = 1;
+    uint8_t full;
+    uint8_t p = *level, t;
+
+    do
+    {
+        // wait for edge
+        while (p == PINVALUE)
+            ;
+
+        TIMER = 0;
+        p = PINVALUE;
+
+        // delay 3/4 bit
+        while (TIMER < delay)
+            ;
+
+        t = PINVALUE;
+
+        full = byte & 0x80;
+        byte <<= 1;
+        if (p != t) byte |= 1;
+        p = t;
+    }
+    while (!full);
+
+    *level = p;
+    return byte;
+}
+#endif // ASMRX
+
+#ifdef MILLER
+//***************************************************************************************
+// miller_byte()
+//
+// Receive the 8 bits of one Miller coded byte (delay modulation). A 1 bit has a
+// transition in its middle, a 0 bit none, but two 0 bits in a row are separated by a
+// transition. So edges are 1, 1.5 or 2 bit times apart and never closer: with the
+// same shortest pulse a bit takes half the time of a manchester bit. What an interval
+// means depends on whether the last edge was in the middle of a bit or at a bit
+// boundary, where a 0 bit is pending:
+//
+//      last edge   interval    bits    next
+//      middle      1           1       middle
+//      middle      1.5         0       boundary
+//      middle      2           0 1     middle
+//      boundary    1           0       boundary
+//      boundary    1.5         0 1     middle
+//
+// The intervals are told apart at 1.25 and 1.75 bit times. They are measured with the
+// 8 bit TIMER, so two bit times have to stay below 256 ticks: at most 64us per bit at
+// 16MHz. 2 samples per bit at 44.1kHz, 45us, is what hex2wav sends.
+//
+// input:     level: pin level after the last edge, updated
+//            shortest, longest: 1.25 and 1.75 bit times in timer ticks
+//
+//***************************************************************************************
+uint8_t millerBoundary;     // the last edge was at a bit boundary
+uint8_t millerCarry;        // the 1 of a pair of bits that didn't fit into the last byte
+
+static uint8_t
+miller_byte(uint8_t *level, uint8_t shortest, uint8_t longest)
+{
+    uint8_t byte = 1;       // sentinel, see rx_byte()
+    uint8_t full;
+    uint8_t p = *level, t;
+    uint8_t value, pair;
+
+    if (millerCarry)
+    {
+        byte = 3;
+        millerCarry = false;
+    }
+
+    while (1)
+    {
+        // wait for edge
+        while (p == PINVALUE)
+            ;
+        t = TIMER;
+        TIMER = 0;
+        p = PINVALUE;
+
+        pair = false;
+        if (t < shortest)
+        {
+            value = !millerBoundary;        // 1, or the pending 0
+        }
+        else if (t < longest && !millerBoundary)
+        {
+            value = 0;
+            millerBoundary = true;
+        }
+        else
+        {
+            value = 1;                      // 0 1
+            pair = true;
+            millerBoundary = false;
+        }
+
+        if (pair)
+        {
+            full = byte & 0x80;
+            byte <<= 1;
+            if (full)
+            {
+                millerCarry = true;
+                break;
+            }
+        }
+        full = byte & 0x80;
+        byte = (byte << 1) | value;
+        if (full) break;
+    }
+
+    *level = p;
+    return byte;
+}
+#endif // MILLER
+
+//***************************************************************************************
+// receiveFrame()
+//
+// This routine receives a differential manchester coded signal at the input pin.
+// The routine waits for a toggling voltage level.
+// It automatically detects the transmission speed.
+//
+// output:    uint8_t flag:     true: checksum OK ( with FEC: frame correctable )
+//            uint8_t FramData: global data buffer
+//
+//***************************************************************************************
+uint8_t
+receiveFrame(void)
+{
+    uint16_t counter = 0;
+    volatile uint16_t time = 0;
+    volatile uint16_t delayTime;
+    uint8_t p, t;
+    uint8_t k = 8;
+    uint8_t dataPointer = 0;
+    uint16_t n;
+#ifdef ZEROCOPY
+    uint16_t fillAddress = 0;
+    uint8_t filling = false;
+#endif
+
+    //*** synchronisation and bit rate estimation **************************
+    // the bit rate is measured anew for every frame, any rate is received as long as
+    // every edge interval, on whole samples, stays below 256 timer ticks (hex2wav -s)
+    time = syncFrame(&p);
+#ifdef RATEFIELD
+    while (time < RATEMINTIME)
+    {
+        // faster than this unit is built for, the program follows at a lower rate:
+        // skip the frame, it ends with a gap longer than any bit
+        TIMER = 0;
+        while (TIMER < 250)
+        {
+            if (p != PINVALUE)
+            {
+                p = PINVALUE;
+                TIMER = 0;
+            }
+        }
+        time = syncFrame(&p);
+    }
+    frameTime = time;
+#endif
+
+#ifdef PAM
+    return pamReceive(time);
+#endif
+
     delayTime = time * 3 / 4 / 8;
     // delay 3/4 bit
     while (TIMER < delayTime)
         ;
 
+#ifdef MILLER
+    //****************** wait for start bit ***************************
+    // the preamble edges are one bit time apart: a half bit starts a manchester
+    // frame, two bit times a Miller frame. At manchester bit rates 1.75 bit times
+    // don't fit into the timer, the frame can only be a manchester frame then.
+    uint16_t limit = time * 7 / 32;
+    uint8_t shortest = time * 5 / 32;
+    uint8_t longest = (limit > 255) ? 255 : limit;
+    uint8_t miller = false;
+
+    while (1)
+    {
+        // wait for edge
+        while (p == PINVALUE)
+            ;
+        t = TIMER;
+        TIMER = 0;
+        p = PINVALUE;
+
+        if (t < delayTime) break;
+        if (t >= longest)
+        {
+            miller = true;
+            millerBoundary = false;
+            millerCarry = false;
+            break;
+        }
+    }
+#else
     //****************** wait for start bit ***************************
     while (p == PINVALUE) // while not startbit ( no change of pinValue means 0 bit )
     {
@@ -359,11 +1066,16 @@ receiveFrame(void)
         counter++;
     }
     p = PINVALUE;
+#endif
 
+#ifdef INTERLEAVE
     //****************************************************************
-    //receive data bits
+    //receive data bits, bit n belongs to frame n % INTERLEAVE
+    uint8_t *frame = FrameData;
+    uint8_t ok = true;
+
     k = 8;
-    for (n = 0; n < (FRAMESIZE * 8); n++)
+    for (n = 0; n < (FRAMEGROUP * FRAMESIZE * 8); n++)
     {
         // wait for edge
         while (p == PINVALUE)
@@ -380,17 +1092,112 @@ receiveFrame(void)
 
         counter++;
 
-        FrameData[dataPointer] = FrameData[dataPointer] << 1;
-        if (p != t) FrameData[dataPointer] |= 1;
+        *frame = *frame << 1;
+        if (p != t) *frame |= 1;
         p = t;
-        k--;
-        if (k == 0)
+        frame += FRAMESIZE;
+        if (frame >= FrameData + FRAMEGROUP * FRAMESIZE)
+        {
+            frame -= FRAMEGROUP * FRAMESIZE;
+            k--;
+            if (k == 0)
+            {
+                frame++;
+                k = 8;
+                eeprom_service();
+            }
+        }
+    }
+
+    for (frame = FrameData; frame < FrameData + FRAMEGROUP * FRAMESIZE; frame += FRAMESIZE)
+    {
+        if (!fec_correct(frame)) ok = false;
+    }
+    return ok;
+#else
+    //****************************************************************
+    //receive data bits
+#ifdef ASMRX
+    // rx_byte() starts after the first edge of its byte
+    uint8_t end = FRAMESIZE;
+    uint8_t late = false;
+
+#ifdef MILLER
+    if (!miller)
+#endif
+    {
+        while (p == PINVALUE)
+            ;
+        TIMER = 0;
+        p = PINVALUE;
+    }
+#endif
+    while (dataPointer < FRAMESIZE)
+    {
+#ifdef MILLER
+        if (miller)
+            FrameData[dataPointer++] = miller_byte(&p, shortest, longest);
+        else
+#endif
+#ifdef ASMRX
+        {
+            uint8_t last = (dataPointer + 1 == end);
+            FrameData[dataPointer++] = rx_byte(&p, delayTime, last, &late);
+        }
+#if !defined(FEC)
+        // erase frames end after the header, no edge of a next byte to wait for
+        if (dataPointer == 1 && ((FrameData[COMMAND] & COMMANDMASK) == ERASECOMMAND || (FrameData[COMMAND] & COMMANDMASK) == CHIPERASECOMMAND)) end = DATAPAGESTART;
+#endif
+#else
+        FrameData[dataPointer++] = rx_byte(&p, delayTime);
+#endif
+
+#ifdef ZEROCOPY
+        // program frames: every complete data word goes straight into the page buffer.
+        // An EEPROM write would clear the buffer, so the EEPROM queue rests for the whole
+        // frame and a write started before it is waited for (it is done by the header).
+        if (dataPointer == DATAPAGESTART && (FrameData[COMMAND] & COMMANDMASK) == PROGCOMMAND)
+        {
+            fillAddress = SPM_PAGESIZE * ((((uint16_t)FrameData[PAGEINDEXHIGH]) << 8) + FrameData[PAGEINDEXLOW]);
+            filling = true;
+            eeprom_busy_wait();
+            boot_rww_enable();  // RWWSRE is CTPB here: clear the page buffer
+        }
+        else if (filling && (dataPointer & 1))
         {
-            dataPointer++;
-            k = 8;
-        };
+            uint16_t w = FrameData[dataPointer - 2] | (FrameData[dataPointer - 1] << 8);
+
+            if (fillAddress == 0)
+            {
+                // the reset vector, see boot_program_page()
+                start_appl_main = (void (*)(void)) (w - RJMP);
+                w = RJMP + BOOTLOADER_ADDRESS / 2;
+            }
+            else if (fillAddress == BOOTLOADER_FUNC_ADDRESS)
+            {
+                w = (uint16_t)(size_t) start_appl_main;
+            }
+            boot_page_fill(fillAddress, w);
+            fillAddress += 2;
+        }
+        else if ((FrameData[COMMAND] & COMMANDMASK) != PROGCOMMAND)
+#endif
+        eeprom_service();
+
+#ifndef FEC
+        // erase frames carry no data
+        if (dataPointer == DATAPAGESTART && ((FrameData[COMMAND] & COMMANDMASK) == ERASECOMMAND || (FrameData[COMMAND] & COMMANDMASK) == CHIPERASECOMMAND)) break;
+#endif
     }
+#ifdef ASMRX
+    if (late) return false;     // the C code per byte missed a sample point
+#endif
+#ifdef FEC
+    return fec_correct(FrameData);
+#else
     return true;
+#endif
+#endif // !INTERLEAVE
 }
 
 /*-----------------------------------------------------------------------------------------------------------------------
@@ -461,47 +1268,283 @@ pgm_write_block (uint16_t flash_addr, uint16_t * block, size_t size)
 
 
 //***************************************************************************************
-//  void boot_program_page (uint32_t page, uint8_t *buf)
+//  void boot_write_page (uint16_t page)
+//
+//  Erase the page and write the page buffer into it.
+//  After a CHIPERASECOMMAND the erase is skipped.
+//
+//***************************************************************************************
+void
+boot_write_page (uint16_t page)
+{
+    eeprom_busy_wait();
+    if (page == 0 || !flashErased)  // page 0 is never erased in advance
+    {
+        boot_page_erase (page);
+        boot_spm_busy_wait ();      // Wait until the memory is erased.
+    }
+    boot_page_write (page);     // Store buffer in flash page.
+    boot_spm_busy_wait();       // Wait until the memory is written.
+}
+
+//***************************************************************************************
+//  void boot_program_page (uint16_t page, uint8_t *buf)
 //
-//  Erase and flash one page.
+//  Fill the page buffer from buf, then erase and flash the page.
 //
 //  input:     page address and data to be programmed
 //
+//  The reset vector and the application vector are patched in buf before the copy,
+//  so the fill loop only moves words: about 14 cycles per word instead of 32 with
+//  the per word busy wait and page 0 check. The buffer is filled before the erase,
+//  which the SPM allows, the CPU is halted during erase and write anyway.
+//
 //***************************************************************************************
 void
-boot_program_page (uint32_t page, uint8_t *buf)
+boot_program_page (uint16_t page, uint8_t *buf)
 {
-    uint16_t i;
+    uint16_t *word = (uint16_t *) buf;
+    uint8_t i;
+
     cli(); // disable interrupts
+    eeprom_busy_wait();         // an EEPROM write would clear the page buffer, no SPM meanwhile
+
+    if (page == 0)
+    {
+        //1.save jump to application vector for later patching
+        start_appl_main = (void (*)(void)) (word[0] - RJMP);
 
-    boot_page_erase(page);
-    boot_spm_busy_wait ();      // Wait until the memory is erased.
+        //2.replace the first word with jump vector to bootloader
+        word[0] = RJMP + BOOTLOADER_ADDRESS / 2;
+    }
+    else if (page == (BOOTLOADER_FUNC_ADDRESS & ~(SPM_PAGESIZE - 1)))
+    {
+        // the application vector goes into the page that covers it,
+        // runProgramm() then has nothing left to write
+        word[(BOOTLOADER_FUNC_ADDRESS % SPM_PAGESIZE) / 2] = (uint16_t)(size_t) start_appl_main;
+    }
 
     for (i = 0; i < SPM_PAGESIZE; i += 2)
     {
-        //read received data
-        uint16_t w = *buf++; //low section
-        w += (*buf++) << 8; //high section
-        //combine low and high to get 16 bit
+        boot_page_fill (page + i, *word++);
+    }
+
+    boot_write_page(page);
+}
+
+#ifdef SERVICES
+//***************************************************************************************
+//  Bootloader services
+//
+//  Flash routines for the application, reached through a table of RJMPs in the last
+//  words of flash (section .svctable, placed at BOOTSERVICES_ADDRESS by the Makefile).
+//  Service n sits at BOOTLOADER_ENDADDRESS - 2 * (n + 1), new services are added in
+//  front so the existing addresses never change. BootServices.h has the prototypes.
+//
+//  The services only use their arguments and the stack, the RAM belongs to the
+//  application. Page 0, the last application page (it holds the application vector at
+//  BOOTLOADER_FUNC_ADDRESS) and the bootloader can't be erased or written, such a request
+//  returns false. Interrupts are disabled while the SPM runs.
+//
+//***************************************************************************************
+#define SVC_PAGE_OK(address) ((address) >= SPM_PAGESIZE && (address) < (BOOTLOADER_FUNC_ADDRESS & ~(SPM_PAGESIZE - 1)))
+
+// service 0: erase the page containing address
+static uint8_t
+svc_page_erase(uint16_t address)
+{
+    uint8_t sreg = SREG;
+
+    if (!SVC_PAGE_OK(address)) return false;
+    cli();
+    eeprom_busy_wait();
+    boot_page_erase(address);
+    boot_spm_busy_wait();
+    SREG = sreg;
+    return true;
+}
+
+// service 1: write the temporary page buffer to an erased page, or over a page
+// whose bits are only cleared, as a log does
+static uint8_t
+svc_page_write(uint16_t address)
+{
+    uint8_t sreg = SREG;
+
+    if (!SVC_PAGE_OK(address)) return false;
+    cli();
+    eeprom_busy_wait();
+    boot_page_write(address);
+    boot_spm_busy_wait();
+    SREG = sreg;
+    return true;
+}
+
+// service 2: fill the temporary page buffer with SPM_PAGESIZE bytes from RAM
+static void
+svc_page_fill(uint16_t address, const uint8_t *buf)
+{
+    uint8_t sreg = SREG;
+    uint8_t i;
+
+    address &= ~(SPM_PAGESIZE - 1);
+    cli();
+    for (i = 0; i < SPM_PAGESIZE; i += 2, buf += 2)
+    {
+        boot_page_fill(address + i, buf[0] | (buf[1] << 8));
+    }
+    SREG = sreg;
+}
+
+// service 4: fill the temporary page buffer from RAM and write it to the page, with
+// interrupts disabled from the EEPROM wait to the end: an EEPROM write in between would
+// clear the buffer
+static uint8_t
+svc_page_fill_write(uint16_t address, const uint8_t *buf)
+{
+    uint8_t sreg = SREG;
+    uint8_t i;
+
+    if (!SVC_PAGE_OK(address)) return false;
+    address &= ~(SPM_PAGESIZE - 1);
+    cli();
+    eeprom_busy_wait();
+    for (i = 0; i < SPM_PAGESIZE; i += 2, buf += 2)
+    {
+        boot_page_fill(address + i, buf[0] | (buf[1] << 8));
+    }
+    boot_page_write(address);
+    boot_spm_busy_wait();
+    SREG = sreg;
+    return true;
+}
+
+// service 3: CRC-16/CCITT (reflected, start value 0xFFFF) of length flash bytes
+static uint16_t
+svc_flash_crc(uint16_t address, uint16_t length)
+{
+    uint16_t crc = 0xFFFF;
+
+    while (length--)
+    {
+        crc = _crc_ccitt_update(crc, pgm_read_byte(address++));
+    }
+    return crc;
+}
+
+// C linkage: the Makefile keeps the table with --undefined=svc_table, also when this
+// file is compiled as main.cpp
+#ifdef __cplusplus
+extern "C"
+#endif
+void svc_table(void) __attribute__((naked, used, section(".svctable")));
+void
+svc_table(void)
+{
+    asm volatile(
+        "rjmp %x0\n\t"     // service 4
+        "rjmp %x1\n\t"     // service 3
+        "rjmp %x2\n\t"     // service 2
+        "rjmp %x3\n\t"     // service 1
+        "rjmp %x4\n\t"     // service 0
+        :
+        : "i" (svc_page_fill_write), "i" (svc_flash_crc), "i" (svc_page_fill), "i" (svc_page_write), "i" (svc_page_erase)
+    );
+}
+#endif // SERVICES
+
+#ifdef COMPRESSION
+//***************************************************************************************
+//  LZSS decompression
+//
+//  The compressed stream is a sequence of groups: one flag byte followed by up to
+//  eight items, LSB of the flags first. A set flag bit is a literal byte, a cleared one
+//  a two byte match:
+//
+//      byte 0: offset bits 0..7
+//      byte 1: offset bits 8..11 (high nibble), match length - 3 (low nibble)
+//
+//  The offset counts back from the current output position, so the window is the
+//  whole image written so far: older bytes are read back from flash, the current page
+//  from PageBuffer. The encoder never references the two reset vector bytes,
+//  which are patched on the way into flash.
+//  Groups never straddle frames.
+//
+//***************************************************************************************
+static void
+lzss_put(uint8_t b)
+{
+    PageBuffer[lzssAddress % PAGESIZE] = b;
+    lzssAddress++;
+
+    if ((lzssAddress % PAGESIZE) == 0)
+    {
+        uint16_t address = lzssAddress - PAGESIZE;
+
+        if (address < BOOTLOADER_ADDRESS) // prevent bootloader from self killing
+        {
+            boot_program_page(address, PageBuffer);
+            TOGGLELED();
+        }
+    }
+}
+
+static uint8_t
+lzss_get(uint16_t address)
+{
+    if (address >= (lzssAddress & ~(PAGESIZE - 1)))
+    {
+        return PageBuffer[address % PAGESIZE];
+    }
+    return pgm_read_byte(address);
+}
+
+static void
+lzss_expand(uint8_t *src, uint8_t length)
+{
+    uint8_t *end = src + length;
+    uint8_t flags = 0;
+    uint8_t items = 0;
 
-        //first page and first index is vector table... ( page 0 and index 0 )
-        if (page == 0 && i == 0)
+    while (src < end)
+    {
+        if (items == 0)
         {
-            //1.save jump to application vector for later patching
-            void* appl = (void *)(w - RJMP);
-            start_appl_main =  ((void (*)(void)) appl);
+            flags = *src++;
+            items = 8;
+            continue;
+        }
 
-            //2.replace w with jump vector to bootloader
-            w = 0xC000 + (BOOTLOADER_ADDRESS / 2) - 1;
+        if (flags & 1)
+        {
+            lzss_put(*src++);
         }
+        else
+        {
+            uint16_t offset = src[0] | ((uint16_t)(src[1] & 0xF0) << 4);
+            uint8_t  count  = (src[1] & 0x0F) + 3;
 
-        boot_page_fill (page + i, w);
-        boot_spm_busy_wait();       // Wait until the memory is written.
+            src += 2;
+            while (count--)
+            {
+                lzss_put(lzss_get(lzssAddress - offset));
+            }
+        }
+        flags >>= 1;
+        items--;
     }
+}
 
-    boot_page_write (page);     // Store buffer in flash page.
-    boot_spm_busy_wait();       // Wait until the memory is written.
+// program the last, partially filled page
+static void
+lzss_flush(void)
+{
+    while (lzssAddress % PAGESIZE)
+    {
+        lzss_put(0xFF);
+    }
 }
+#endif // COMPRESSION
 
 void
 resetRegister(void)
@@ -509,6 +1552,13 @@ resetRegister(void)
     DDRB = 0;
     cli();
     TCCR0B = 0; // turn off timer1
+#if defined(ACOMP) || defined(ADCSLICER)
+    ADCSRA = 0;
+    ACSR = 0;
+    ADCSRB = 0;
+    ADMUX = 0;
+    DIDR0 = 0;
+#endif
 }
 
 void
@@ -523,15 +1573,57 @@ exitBootloader(void)
     }
 }
 
+//***************************************************************************************
+//  store the application vector
+//
+//  Usually the vector was already written with the last application page. Otherwise
+//  the word is erased or holds an older vector: if only bits have to be cleared the
+//  page is written without an erase, the buffer holding 0xFFFF everywhere else.
+//  Only if bits have to be set the page is erased and rewritten.
+//
+//***************************************************************************************
+static void
+storeApplicationVector(void)
+{
+    uint16_t vector = (uint16_t)(size_t) start_appl_main;
+    uint16_t stored = pgm_read_word(BOOTLOADER_FUNC_ADDRESS);
+
+    if (stored == vector) return;
+
+    if ((stored & vector) == vector)
+    {
+        uint16_t start_addr = BOOTLOADER_FUNC_ADDRESS & ~(SPM_PAGESIZE - 1);
+        uint16_t addr;
+
+        eeprom_busy_wait();
+        for (addr = start_addr; addr < start_addr + SPM_PAGESIZE; addr += 2)
+        {
+            boot_page_fill(addr, addr == BOOTLOADER_FUNC_ADDRESS ? vector : 0xFFFF);
+        }
+        boot_page_write(start_addr);
+        boot_spm_busy_wait();
+    }
+    else
+    {
+        pgm_write_block (BOOTLOADER_FUNC_ADDRESS, (uint16_t *) &start_appl_main, sizeof (start_appl_main));
+    }
+}
+
 void
 runProgramm(void)
 {
-    // reintialize registers to default
-    resetRegister();
+    // start_appl_main is only known if page 0 came with this upload,
+    // an EEPROM only upload runs the application already in flash
+    if (start_appl_main)
+    {
+        // reintialize registers to default
+        resetRegister();
 
-    pgm_write_block (BOOTLOADER_FUNC_ADDRESS, (uint16_t *) &start_appl_main, sizeof (start_appl_main));
+        storeApplicationVector();
 
-    start_appl_main();
+        start_appl_main();
+    }
+    exitBootloader();
 }
 
 //***************************************************************************************
@@ -547,23 +1639,23 @@ a_main(void)
 
 #ifdef WONKYSTUFF
     // wait whilst the reset button is held down (and turn on the LED to say that we're waiting)
-    uint32_t lPress=0;
-#ifdef MMO
-    while ((PINB & BOOTCHECKPIN))
-#else
-    while (!(PINB & BOOTCHECKPIN))
-#endif
+    uint16_t overflows = 0;
+    while (BOOTBUTTONPRESSED())
     {
         LEDON();           // Switch on the LED
-        if (++lPress > 3000000)         // pretty arbitrary count
+        if (TIFR & _BV(TOV0))
         {
-            // Wait for audio bootloader shenanigans
-            break;
+            TIFR = _BV(TOV0);           // cleared by writing a one
+            if (++overflows >= BOOTENTRY_OVERFLOWS)
+            {
+                // Wait for audio bootloader shenanigans
+                break;
+            }
         }
     }
     LEDOFF();
 
-    if (lPress < 3000000)
+    if (overflows < BOOTENTRY_OVERFLOWS)
     {
         // leave bootloader and run program
         exitBootloader();
@@ -611,7 +1703,7 @@ a_main(void)
 
     while (1)
     {
-        if (!receiveFrame())
+        if (!receiveFrame() || !RATECHECK())
         {
             //*****  if data transfer error: blink fast, press reset to restart *******************
             while (1)
@@ -630,52 +1722,115 @@ a_main(void)
         }
         else // succeed
         {
-            switch (FrameData[COMMAND])
+            uint8_t *frame;
+
+            // every frame of an interleaved group in turn
+            for (frame = FrameData; frame < FrameData + FRAMEGROUP * FRAMESIZE; frame += FRAMESIZE)
             {
-                case PROGCOMMAND:
+                switch (frame[COMMAND])
                 {
-                    uint16_t pageNumber = (((uint16_t)FrameData[PAGEINDEXHIGH]) << 8) + FrameData[PAGEINDEXLOW];
-                    uint16_t address=SPM_PAGESIZE * pageNumber;
-
-                    if( address < BOOTLOADER_ADDRESS) // prevent bootloader form self killing
+                    case PROGCOMMAND:
                     {
-                        boot_program_page(address, FrameData + DATAPAGESTART);  // erase and program page
-                        TOGGLELED();
+                        uint16_t pageNumber = (((uint16_t)frame[PAGEINDEXHIGH]) << 8) + frame[PAGEINDEXLOW];
+                        uint16_t address=SPM_PAGESIZE * pageNumber;
+
+                        if( address < BOOTLOADER_ADDRESS) // prevent bootloader form self killing
+                        {
+#ifdef ZEROCOPY
+                            boot_write_page(address);   // the page buffer was filled by receiveFrame()
+#else
+                            boot_program_page(address, frame + DATAPAGESTART);  // erase and program page
+#endif
+                            TOGGLELED();
+                        }
+#ifdef ZEROCOPY
+                        else
+                        {
+                            boot_rww_enable();  // drop the page buffer
+                        }
+#endif
                     }
-                }
-                break;
+                    break;
 
-                case RUNCOMMAND:
-                {
-                    // after programming leave bootloader and run program
-                    runProgramm();
-                }
-                break;
+#ifdef COMPRESSION
+                    case LZSSCOMMAND:
+                    {
+                        uint8_t data_length = frame[LENGTHLOW];
 
-                case EEPROMCOMMAND:
-                {
-                    uint8_t pageNumber = FrameData[PAGEINDEXLOW];
-                    uint8_t data_length = FrameData[LENGTHLOW];
-                    uint8_t address = SPM_PAGESIZE * pageNumber;
+                        if (data_length > PAGESIZE) data_length = PAGESIZE;
+                        lzss_expand(frame + DATAPAGESTART, data_length);
+                    }
+                    break;
+#endif
 
-                    uint8_t *buf = FrameData + DATAPAGESTART;
+                    case CHIPERASECOMMAND:
+                    case ERASECOMMAND:
+                    {
+                        uint16_t pageNumber = (((uint16_t)frame[PAGEINDEXHIGH]) << 8) + frame[PAGEINDEXLOW];
+                        uint8_t pages = frame[LENGTHLOW];
+
+                        // one long erase at the start of an upload, the program frames then only write
+                        if (frame[COMMAND] == CHIPERASECOMMAND)
+                        {
+                            pageNumber = 1;
+                            pages = LAST_PAGE;
+                            flashErased = true;
+                        }
+
+                        while (pages--)
+                        {
+                            uint16_t address = SPM_PAGESIZE * pageNumber++;
+
+                            // page 0 holds the jump to the bootloader, it is always sent as a program frame
+                            if (address != 0 && address < BOOTLOADER_ADDRESS)
+                            {
+                                eeprom_busy_wait();
+                                boot_page_erase(address);
+                                boot_spm_busy_wait();
+                            }
+                        }
+                        TOGGLELED();
+                    }
+                    break;
 
-                    for (uint8_t i = 0; i < data_length; i++)
+                    case RUNCOMMAND:
                     {
-                        //write received data to EEPROM
-                        uint8_t w = *buf++;
-                        eeprom_write(address + i, w);
+                        eeprom_flush();
+#ifdef COMPRESSION
+                        lzss_flush();
+#endif
+                        // after programming leave bootloader and run program
+                        runProgramm();
                     }
+                    break;
 
-                    //Leave bootloader after eeprom signal received
-                    //todo: wait until all data sent > spm pagesize (64)
-                    //fix this!!!!
-                    LEDOFF();
-                    exitBootloader();
+                    case EEPROMCOMMAND:
+                    {
+                        // an EEPROM upload may span several frames, it ends with the RUNCOMMAND
+                        uint16_t pageNumber = (((uint16_t)frame[PAGEINDEXHIGH]) << 8) + frame[PAGEINDEXLOW];
+                        uint8_t data_length = frame[LENGTHLOW];
+                        uint16_t address = SPM_PAGESIZE * pageNumber;
+
+                        uint8_t *buf = frame + DATAPAGESTART;
+
+                        if (data_length > PAGESIZE) data_length = PAGESIZE;
+
+                        // the previous frame is usually written by now
+                        eeprom_flush();
+                        for (uint8_t i = 0; i < data_length; i++)
+                        {
+                            EepromQueue[i] = *buf++;
+                        }
+                        eepromQueueAddress = address;
+                        eepromQueueHead = 0;
+                        eepromQueueEnd = data_length;
+                        eeprom_service();
+                        TOGGLELED();
+                    }
+                    break;
                 }
-                break;
+                frame[COMMAND] = NOCOMMAND; // delete command
             }
-            FrameData[COMMAND] = NOCOMMAND; // delete command
         }
     }
 }
@@ -683,9 +1838,20 @@ a_main(void)
 int
 main(void)
 {
+    INITBOOTCHECK();
+
+#ifdef WONKYSTUFF
+    // give the pull-up a moment, then start the application straight away
+    // if the button isn't pressed: nothing else is set up yet
+    nop(); nop(); nop(); nop();
+    if (!BOOTBUTTONPRESSED())
+    {
+        exitBootloader();
+    }
+#endif
+
     INITLED();
     INITAUDIOPORT();
-    INITBOOTCHECK();
 
     // Timer 2 normal mode, clk/8, count up from 0 to 255
     // ==> frequency @16MHz= 16MHz/8/256=7812.5Hz
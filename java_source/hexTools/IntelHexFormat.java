@@ -241,6 +241,37 @@ public class IntelHexFormat
 
         return baos.toByteArray();
     }
+    /**
+     * Place all blocks of a formatted byte array at their addresses
+     *
+     * @param data formatted byte array
+     * @return unsigned bytes from address 0 up to the end of the last block,
+     *         -1 where the file has no data
+     */
+    public static int[] toUnsignedIntImage(byte[] data)
+    {
+        int end=0;
+        for(int n=0;n<data.length;)
+        {
+            int length=(toUnsignedInt(data[n])<<16)+(toUnsignedInt(data[n+1])<<8)+toUnsignedInt(data[n+2]);
+            int address=(toUnsignedInt(data[n+3])<<16)+(toUnsignedInt(data[n+4])<<8)+toUnsignedInt(data[n+5]);
+            end=Math.max(end,address+length);
+            n+=6+length;
+        }
+
+        int[] image=new int[end];
+        for(int n=0;n<end;n++) image[n]=-1;
+
+        for(int n=0;n<data.length;)
+        {
+            int length=(toUnsignedInt(data[n])<<16)+(toUnsignedInt(data[n+1])<<8)+toUnsignedInt(data[n+2]);
+            int address=(toUnsignedInt(data[n+3])<<16)+(toUnsignedInt(data[n+4])<<8)+toUnsignedInt(data[n+5]);
+            for(int k=0;k<length;k++) image[address+k]=toUnsignedInt(data[n+6+k]);
+            n+=6+length;
+        }
+        return image;
+    }
+
     public static byte[] discardHeaderBytes(byte[] data)
     {
     	int headerOffset=6;
@@ -35,6 +35,11 @@ public class BootFrame {
 
 	//private double silenceBetweenPages=2; // 2 seconds for debugging purposes silence in seconds
 	private double silenceBetweenPages=0.02; // silence in seconds
+	private double silencePerErasedPage=0.005; // page erase takes 4.5ms
+	private double silenceBetweenWrittenPages=0.012; // after a chip erase a page write takes 4.5ms
+	private int chipErasePages=110; // application pages erased by the chip erase: 0x1BC0 / 64 - 1
+	private double silencePerEepromByte=0.0035; // EEPROM erase and write takes 3.4ms per byte
+	private double silencePerErasedEepromByte=0.0019; // 0xFF only needs an erase, 1.8ms
 	
 	public BootFrame()
 	{
@@ -58,6 +63,30 @@ public class BootFrame {
 	{
 		command=1;
 	}	
+
+	// pageIndex counts 64 byte EEPROM pages, totalLength is the number of bytes in this frame
+	public void setEepromCommand()
+	{
+		command=4;
+	}
+
+	// data holds LZSS compressed image bytes, totalLength their number in this frame
+	public void setLzssCommand()
+	{
+		command=6;
+	}
+
+	// header only frame: erase totalLength pages starting at pageIndex
+	public void setEraseCommand()
+	{
+		command=7;
+	}
+
+	// header only frame: erase all application pages but page 0, program frames only write
+	public void setChipEraseCommand()
+	{
+		command=8;
+	}
 	
 	public int[] addFrameParameters(int data[])
 	{
@@ -136,4 +165,44 @@ public class BootFrame {
 	public double getSilenceBetweenPages() {
 		return silenceBetweenPages;
 	}
+
+	public void setSilencePerErasedPage(double silencePerErasedPage) {
+		this.silencePerErasedPage = silencePerErasedPage;
+	}
+
+	public double getSilencePerErasedPage() {
+		return silencePerErasedPage;
+	}
+
+	public void setSilenceBetweenWrittenPages(double silenceBetweenWrittenPages) {
+		this.silenceBetweenWrittenPages = silenceBetweenWrittenPages;
+	}
+
+	public double getSilenceBetweenWrittenPages() {
+		return silenceBetweenWrittenPages;
+	}
+
+	public void setChipErasePages(int chipErasePages) {
+		this.chipErasePages = chipErasePages;
+	}
+
+	public int getChipErasePages() {
+		return chipErasePages;
+	}
+
+	public void setSilencePerEepromByte(double silencePerEepromByte) {
+		this.silencePerEepromByte = silencePerEepromByte;
+	}
+
+	public double getSilencePerEepromByte() {
+		return silencePerEepromByte;
+	}
+
+	public void setSilencePerErasedEepromByte(double silencePerErasedEepromByte) {
+		this.silencePerErasedEepromByte = silencePerErasedEepromByte;
+	}
+
+	public double getSilencePerErasedEepromByte() {
+		return silencePerErasedEepromByte;
+	}
 }
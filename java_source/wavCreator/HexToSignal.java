@@ -15,24 +15,51 @@ public class HexToSignal
 	private int     highNumberOfPulses  =  3; // not for manchester coding, only for flankensignal
 	
 	private int     manchesterNumberOfSamplesPerBit = 4; // this value must be even
+	private double  manchesterSamplesPerBit = 4; // half samples allowed, see setSamplesPerBit()
 	private boolean useDifferentialManchsterCode = true;
 	
 	public void setSignalSpeed(boolean fullSpeedFlag)
 	{
 		if( fullSpeedFlag ) manchesterNumberOfSamplesPerBit = 4; // full speed
 		else                manchesterNumberOfSamplesPerBit = 8; // half speed
+		manchesterSamplesPerBit = manchesterNumberOfSamplesPerBit;
 	}
 	
+	/* Manchester bit rates between full and half speed, or above full speed.
+	 * The edges are placed by the bit phase of each sample ( sample number / samples per bit ),
+	 * so with a half sample step the halves of a bit differ by one sample and the timing
+	 * does not drift. The bootloader samples 3/4 bit after the edge in the middle of a bit,
+	 * the edges fall on whole samples. Checked at 44.1kHz: 3, 3.5, 4, 4.5 and 5 samples per
+	 * bit leave at least 0.375 samples ( 8.5us, at 3.5 ) between the sample point and the
+	 * neighbouring edges, and the longest interval ( 5 samples, 227 timer ticks ) fits into
+	 * the 8 bit timer of the bootloader. Above 5 some intervals are 6 samples and the timer
+	 * wraps, finer fractions place edges almost on the sample point.
+	 * Only used for manchester coding.
+	 */
+	public void setSamplesPerBit(double samplesPerBit)
+	{
+		manchesterSamplesPerBit = samplesPerBit;
+	}
+
 	public HexToSignal(boolean fullSpeedFlag)
 	{
 		setSignalSpeed(fullSpeedFlag);
 	}
+
+	// first sample at or after the given bit phase
+	private int manchesterSample(double bitPhase)
+	{
+		return (int)Math.ceil(bitPhase*manchesterSamplesPerBit-1e-9);
+	}
+
 	/* flag=true: rising edge
 	 * flag=false: falling edge
 	 */
-	private double[] manchesterEdge(boolean flag, int pointerIntoSignal, double signal[] )
+	private void manchesterEdge(boolean flag, int bitNumber, double signal[] )
 	{
-		double sigpart[]=new double[manchesterNumberOfSamplesPerBit];
+		int start=manchesterSample(bitNumber);
+		int middle=manchesterSample(bitNumber+0.5);
+		int end=manchesterSample(bitNumber+1);
 		int n;
 		double value;
 
@@ -41,42 +68,89 @@ public class HexToSignal
 			if(flag) value=1;
 			else value=-1;
 			if(invertSignal)value=value*-1;  // correction of an inverted audio signal line
-			for(n=0;n<manchesterNumberOfSamplesPerBit;n++)
+			for(n=start;n<end;n++)
 			{
-				if(n<manchesterNumberOfSamplesPerBit/2)signal[pointerIntoSignal]=-value;
-				else signal[pointerIntoSignal]=value;
-				pointerIntoSignal++;
+				if(n<middle)signal[n]=-value;
+				else signal[n]=value;
 			}
 		}
 		else // differential manchester code ( inverted )
 		{
 			if(flag) manchesterPhase=-manchesterPhase; // toggle phase
-			for(n=0;n<manchesterNumberOfSamplesPerBit;n++)
+			for(n=start;n<end;n++)
 			{
-				if(n==(manchesterNumberOfSamplesPerBit/2))manchesterPhase=-manchesterPhase; // toggle phase
-				signal[pointerIntoSignal]=manchesterPhase;
-				pointerIntoSignal++;
+				if(n==middle)manchesterPhase=-manchesterPhase; // toggle phase
+				signal[n]=manchesterPhase;
 			}		
 		}
-		return sigpart;
+	}
+
+	/* extended Hamming code (SECDED) over the whole frame, appended as two bytes:
+	 * check bits 0..9 and the overall parity in bit 15.
+	 * Data bits are numbered in sending order ( MSB first ) starting at 3 and
+	 * skipping the powers of two, which are the positions of the check bits.
+	 */
+	public int[] hammingCoding(int hexdata[])
+	{
+		int[] coded=new int[hexdata.length+2];
+		int syndrome=0;
+		int parity=0;
+		int position=2;
+
+		for(int n=0;n<hexdata.length;n++)
+		{
+			coded[n]=hexdata[n];
+			for(int mask=0x80;mask!=0;mask>>=1)
+			{
+				position++;
+				if((position&(position-1))==0) position++;
+				if((hexdata[n]&mask)!=0)
+				{
+					syndrome^=position;
+					parity^=1;
+				}
+			}
+		}
+		parity^=Integer.bitCount(syndrome)&1; // the check bits are part of the overall parity
+		int check=syndrome|(parity<<15);
+		coded[hexdata.length]=check&0xFF;
+		coded[hexdata.length+1]=(check>>8)&0xFF;
+		return coded;
+	}
+
+	/* bit n of the result is bit n/depth of frame n%depth: a burst of up to depth
+	 * bit errors hits every frame only once and can be corrected frame by frame.
+	 * All frames must have the same length.
+	 */
+	public int[] interleave(int frames[][])
+	{
+		int depth=frames.length;
+		int[] stream=new int[depth*frames[0].length];
+
+		for(int n=0;n<stream.length*8;n++)
+		{
+			int bit=n/depth;
+			if((frames[n%depth][bit/8]&(0x80>>(bit%8)))!=0) stream[n/8]|=0x80>>(n%8);
+		}
+		return stream;
 	}
 
 	public double[] manchesterCoding(int hexdata[])
 	{
 		int laenge=hexdata.length;
-		double[] signal=new double[(1+startSequencePulses+laenge*8)*manchesterNumberOfSamplesPerBit];
+		double[] signal=new double[manchesterSample(1+startSequencePulses+laenge*8)];
 		
 		int counter=0;
 		/** generate synchronisation start sequence **/
 		for (int n=0; n<startSequencePulses; n++)
 		{
 			manchesterEdge(false,counter,signal); // 0 bits: generate falling edges 
-			counter+=manchesterNumberOfSamplesPerBit;
+			counter++;
 		}
 		
 		/** start bit **/
 		manchesterEdge(true,counter,signal); //  1 bit:  rising edge 
-		counter+=manchesterNumberOfSamplesPerBit;
+		counter++;
 		
 		/** create data signal **/
 		int count=0;
@@ -89,12 +163,101 @@ public class HexToSignal
 			{
 				if((dat&0x80)==0) 	manchesterEdge(false,counter,signal); // generate falling edges ( 0 bits )
 				else 				manchesterEdge(true,counter,signal); // rising edge ( 1 bit )
-				counter+=manchesterNumberOfSamplesPerBit;	
+				counter++;	
 				dat=dat<<1; // shift to next bit
 			}
 		}
 		return signal;	
 	}
+	/* 4-PAM: two bits per symbol as one of four levels, Gray coded, MSB first.
+	 * A symbol is +level for the first and -level for the second half, like a manchester
+	 * bit it is free of DC and has an edge in the middle for the receiver to sync to.
+	 * The preamble alternates full levels, two full positive symbols in a row start the data.
+	 * Needs a bootloader built with ADCSLICER=1 PAM=1.
+	 */
+	private static final double[] pamLevel = { -1.0, -1.0/3, 1.0, 1.0/3 }; // bits 00, 01, 10, 11
+
+	private void pamSymbol(double level, int pointerIntoSignal, double signal[])
+	{
+		for(int n=0;n<manchesterNumberOfSamplesPerBit;n++)
+		{
+			if(n<manchesterNumberOfSamplesPerBit/2) signal[pointerIntoSignal]=level;
+			else signal[pointerIntoSignal]=-level;
+			pointerIntoSignal++;
+		}
+	}
+
+	public double[] pamCoding(int hexdata[])
+	{
+		double[] signal=new double[(startSequencePulses+2+hexdata.length*4)*manchesterNumberOfSamplesPerBit];
+		int counter=0;
+
+		/** level training preamble, ends with a negative symbol **/
+		for (int n=0; n<startSequencePulses; n++)
+		{
+			pamSymbol((n%2==0) ? 1 : -1,counter,signal);
+			counter+=manchesterNumberOfSamplesPerBit;
+		}
+
+		/** start marker **/
+		for (int n=0; n<2; n++)
+		{
+			pamSymbol(1,counter,signal);
+			counter+=manchesterNumberOfSamplesPerBit;
+		}
+
+		/** data: four symbols per byte **/
+		for (int count=0;count<hexdata.length;count++)
+		{
+			for (int shift=6;shift>=0;shift-=2)
+			{
+				pamSymbol(pamLevel[(hexdata[count]>>shift)&3],counter,signal);
+				counter+=manchesterNumberOfSamplesPerBit;
+			}
+		}
+		return signal;
+	}
+
+	/* Miller code ( delay modulation ): a 1 bit has an edge in its middle, a 0 bit none,
+	 * two 0 bits in a row are separated by an edge at the bit start. There is at most one
+	 * edge per bit, so it needs half the samples per bit of the manchester code.
+	 * The preamble of 1 bits ends with 0 1, the interval of two bit times tells the
+	 * bootloader to decode Miller code. A trailing 1 bit closes the last data bit.
+	 * The longest interval is two bit times, it has to fit into the 8 bit timer of the
+	 * bootloader, hence always 2 samples per bit.
+	 * Needs a bootloader built with MILLER=1.
+	 */
+	private int millerNumberOfSamplesPerBit = 2; // this value must be even
+
+	public double[] millerCoding(int hexdata[])
+	{
+		int bits=startSequencePulses+2+hexdata.length*8+1;
+		double[] signal=new double[bits*millerNumberOfSamplesPerBit];
+		double level=1;
+		boolean lastBit=true;
+		int counter=0;
+
+		for (int n=0; n<bits; n++)
+		{
+			boolean bit;
+			int k=n-startSequencePulses-2;
+			if(n<startSequencePulses)                bit=true;  // preamble
+			else if(n==startSequencePulses)          bit=false; // start marker 0 1
+			else if(n==startSequencePulses+1)        bit=true;
+			else if(k<hexdata.length*8)              bit=(hexdata[k/8]&(0x80>>(k%8)))!=0; // MSB first
+			else                                     bit=true;  // closes the last data bit
+
+			if(!bit && !lastBit) level=-level;
+			for(int s=0;s<millerNumberOfSamplesPerBit;s++)
+			{
+				if(bit && s==millerNumberOfSamplesPerBit/2) level=-level;
+				signal[counter++]=level;
+			}
+			lastBit=bit;
+		}
+		return signal;
+	}
+
 	public double[] flankensignal(int hexdata[])
 	{
 		int intro=startSequencePulses*lowNumberOfPulses+numStartBits*highNumberOfPulses+numStopBits*lowNumberOfPulses;
@@ -0,0 +1,105 @@
+/*
+ * wave generator for audio bootloader
+ * LZSS compression of the flash image for compressed program frames
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+package wavCreator;
+
+import java.util.ArrayList;
+
+/*
+ * Stream format, as expanded by lzss_expand() in the bootloader:
+ *
+ *   group: one flag byte, then up to 8 items, LSB of the flags first
+ *   flag bit 1: literal byte
+ *   flag bit 0: match, 2 bytes
+ *       byte 0: offset bits 0..7
+ *       byte 1: offset bits 8..11 (high nibble), length - 3 (low nibble)
+ *
+ * The offset counts back from the current output position. Groups are kept
+ * whole so that a frame can always be expanded on its own.
+ */
+public class LzssCompressor
+{
+    public static final int MINMATCH = 3;
+    public static final int MAXMATCH = 18;
+    public static final int WINDOW   = 4095;
+
+    // the bootloader patches the reset vector (bytes 0 and 1) before they reach flash,
+    // so matches must never copy from there
+    private static final int PROTECTED = 2;
+
+    private ArrayList<int[]>   groups         = new ArrayList<int[]>();
+    private ArrayList<Integer> expandedLength = new ArrayList<Integer>();
+
+    public LzssCompressor(int data[])
+    {
+        int pos=0;
+
+        while(pos<data.length)
+        {
+            int[] group=new int[1+8*2];
+            int length=1;
+            int flags=0;
+            int expanded=0;
+
+            for(int item=0;item<8 && pos<data.length;item++)
+            {
+                int bestLength=0;
+                int bestOffset=0;
+
+                for(int start=Math.max(PROTECTED,pos-WINDOW);start<pos;start++)
+                {
+                    int n=0;
+                    while(n<MAXMATCH && pos+n<data.length && data[start+n]==data[pos+n]) n++;
+                    if(n>bestLength)
+                    {
+                        bestLength=n;
+                        bestOffset=pos-start;
+                    }
+                }
+
+                if(bestLength>=MINMATCH)
+                {
+                    group[length++]=bestOffset&0xFF;
+                    group[length++]=((bestOffset>>4)&0xF0)|(bestLength-MINMATCH);
+                    pos+=bestLength;
+                    expanded+=bestLength;
+                }
+                else
+                {
+                    flags|=1<<item;
+                    group[length++]=data[pos++];
+                    expanded++;
+                }
+            }
+            group[0]=flags;
+
+            int[] g=new int[length];
+            for(int n=0;n<length;n++) g[n]=group[n];
+            groups.add(g);
+            expandedLength.add(expanded);
+        }
+    }
+
+    public int getNumberOfGroups()
+    {
+        return groups.size();
+    }
+
+    public int[] getGroup(int index)
+    {
+        return groups.get(index);
+    }
+
+    // number of image bytes the group expands to
+    public int getExpandedLength(int index)
+    {
+        return expandedLength.get(index);
+    }
+}
@@ -14,6 +14,7 @@
 package wavCreator;
 
 import java.io.*;
+import java.util.ArrayList;
 
 import hexTools.IntelHexFormat;
 import waveFile.AePlayWave;
@@ -24,6 +25,20 @@ public class WavCodeGenerator
     private int sampleRate = 44100;     // Samples per second
     private BootFrame frameSetup;
     boolean fullSpeedFlag=true;
+    double samplesPerBit=0;     // 0: given by fullSpeedFlag
+    int[] rateCodes=null;       // samples per bit times two of each pass, fastest first
+    boolean compressFlag=false;
+    boolean fecFlag=false;
+    int interleaveDepth=1;
+    boolean chipEraseFlag=false;
+    boolean pamFlag=false;
+    boolean millerFlag=false;
+
+    // frames of the upload in sending order, each one followed by a silence
+    // overlapped: the bootloader goes on working while the next frame is received
+    private ArrayList<int[]>   frames     = new ArrayList<int[]>();
+    private ArrayList<Double>  silences   = new ArrayList<Double>();
+    private ArrayList<Boolean> overlapped = new ArrayList<Boolean>();
 
     public WavCodeGenerator()
     {
@@ -45,10 +60,183 @@ public class WavCodeGenerator
         this.fullSpeedFlag = fullSpeedFlag;
     }
 
+    // manchester bit rate as samples per bit, in half sample steps, see HexToSignal
+    public void setSamplesPerBit(double samplesPerBit)
+    {
+        this.samplesPerBit = samplesPerBit;
+    }
+
+    // the whole upload once per rate, fastest first, every frame carries its rate in the
+    // high nibble of the command: each unit skips the rates above what it was built for
+    // and takes the first one it can. Needs a bootloader built with RATEFIELD=1.
+    public void setRatePasses(double[] samplesPerBit)
+    {
+        double[] spb=samplesPerBit.clone();
+        java.util.Arrays.sort(spb);
+        rateCodes=new int[spb.length];
+        for(int n=0;n<spb.length;n++) rateCodes[n]=(int)Math.round(spb[n]*2);
+    }
+
+    // needs a bootloader built with COMPRESS=1
+    public void setCompression(boolean compressFlag)
+    {
+        this.compressFlag = compressFlag;
+    }
+
+    // needs a bootloader built with FEC=1
+    public void setErrorCorrection(boolean fecFlag)
+    {
+        this.fecFlag = fecFlag;
+    }
+
+    // interleave the bits of 'depth' frames, needs a bootloader built with FEC=1 INTERLEAVE=depth
+    // interleaving only pays off together with error correction, so it switches that on too
+    public void setInterleaveDepth(int depth)
+    {
+        this.interleaveDepth = depth;
+        if(depth>1) fecFlag=true;
+    }
+
+    // erase the whole application flash first, the page frames then only need a page write
+    public void setChipErase(boolean chipEraseFlag)
+    {
+        this.chipEraseFlag = chipEraseFlag;
+    }
+
+    // 4 level symbols with 2 bits each, needs a bootloader built with ADCSLICER=1 PAM=1
+    public void setPamCoding(boolean pamFlag)
+    {
+        this.pamFlag = pamFlag;
+    }
+
+    // Miller code with half the samples per bit, needs a bootloader built with MILLER=1
+    public void setMillerCoding(boolean millerFlag)
+    {
+        this.millerFlag = millerFlag;
+    }
+
+    // queue a frame, followed by 'duration' seconds of silence for the bootloader to process it
+    private void addFrame(int frameData[], double duration)
+    {
+        addFrame(frameData,duration,false);
+    }
+
+    // overlap: the processing continues during the next frame, the silence is shortened by its length
+    private void addFrame(int frameData[], double duration, boolean overlap)
+    {
+        frames.add(frameData);
+        silences.add(duration);
+        overlapped.add(overlap);
+    }
+
+    // line coding of all queued frames, in groups of interleaveDepth frames
+    // rateCode: samples per bit times two, sent in the high nibble of the commands, 0: none
+    private double[] encodeFrames(int rateCode)
+    {
+        double[] signal=new double[1];
+
+        for(int f=0;f<frames.size();f+=interleaveDepth)
+        {
+            HexToSignal h2s=new HexToSignal(fullSpeedFlag);
+            if(rateCode>0)           h2s.setSamplesPerBit(rateCode/2.0);
+            else if(samplesPerBit>0) h2s.setSamplesPerBit(samplesPerBit);
+            int[][] group=new int[interleaveDepth][];
+            double duration=0;
+            boolean overlap=false;
+
+            for(int n=0;n<interleaveDepth;n++)
+            {
+                int[] frameData;
+                if(f+n<frames.size())
+                {
+                    frameData=frames.get(f+n);
+                    duration+=silences.get(f+n);
+                    overlap=overlapped.get(f+n);
+                }
+                else frameData=new int[frameSetup.getFrameSize()]; // NOCOMMAND filler for the last group
+
+                if(rateCode>0)
+                {
+                    frameData=frameData.clone();
+                    frameData[0]|=rateCode<<4; // command byte, see BootFrame.addFrameParameters()
+                }
+                if(fecFlag) frameData=h2s.hammingCoding(frameData);
+                group[n]=frameData;
+            }
+            double[] sig;
+            if(pamFlag)         sig=h2s.pamCoding(h2s.interleave(group));
+            else if(millerFlag) sig=h2s.millerCoding(h2s.interleave(group));
+            else                sig=h2s.manchesterCoding(h2s.interleave(group));
+            signal=appendSignal(signal,sig);
+
+            // the next group takes as long as this one
+            if(overlap) duration=frameSetup.getSilenceBetweenPages()+Math.max(0,duration-(double)sig.length/sampleRate);
+            signal=appendSignal(signal,silence(duration));
+        }
+        return signal;
+    }
+
+    private void clearFrames()
+    {
+        frames.clear();
+        silences.clear();
+        overlapped.clear();
+    }
+
+    // line coded signal of the queued frames, the queue is emptied afterwards
+    private double[] encodeQueued()
+    {
+        double[] signal=encodeFrames(0);
+        clearFrames();
+        return signal;
+    }
+
+    private double[] encodeFrame(int frameData[])
+    {
+        clearFrames();
+        addFrame(frameData,0);
+        return encodeQueued();
+    }
+
+    /* signals of single frames and frame sequences with the current settings,
+     * for applications building their own WAVs ( the API before the frame queue )
+     */
     public double[] generatePageSignal(int data[])
     {
-        HexToSignal h2s=new HexToSignal(fullSpeedFlag);
+        return encodeFrame(makePageFrame(data));
+    }
+
+    public double[] makeRunCommand()
+    {
+        return encodeFrame(makeRunFrame());
+    }
+
+    public double[] makeTestCommand()
+    {
+        return encodeFrame(makeTestFrame());
+    }
+
+    public double[] makeEraseCommand(int firstPage, int pages)
+    {
+        return encodeFrame(makeEraseFrame(firstPage,pages));
+    }
+
+    public double[] generateProgSignal(int data[])
+    {
+        clearFrames();
+        addProgFrames(data);
+        return encodeQueued();
+    }
+
+    public double[] generateCompressedSignal(int data[])
+    {
+        clearFrames();
+        addCompressedFrames(data);
+        return encodeQueued();
+    }
 
+    public int[] makePageFrame(int data[])
+    {
         int[] frameData=new int[frameSetup.getFrameSize()];
 
         // copy data into frame data
@@ -58,8 +246,7 @@ public class WavCodeGenerator
             else frameData[n+frameSetup.getPageStart()]=0xFF;
         }
         frameSetup.addFrameParameters(frameData);
-        double[] signal=h2s.manchesterCoding(frameData);
-        return signal;
+        return frameData;
     }
 
     // duration in seconds
@@ -69,41 +256,79 @@ public class WavCodeGenerator
         return signal;
     }
 
-    public double[] makeRunCommand()
+    public int[] makeRunFrame()
     {
-        HexToSignal h2s=new HexToSignal(fullSpeedFlag);
         int[] frameData=new int[frameSetup.getFrameSize()];
         frameSetup.setRunCommand();
         frameSetup.addFrameParameters(frameData);
-        double[] signal=h2s.manchesterCoding(frameData);
-        return signal;
+        return frameData;
     }
 
-    public double[] makeTestCommand()
+    public int[] makeTestFrame()
     {
-        HexToSignal h2s=new HexToSignal(fullSpeedFlag);
         int[] frameData=new int[frameSetup.getFrameSize()];
         frameSetup.setTestCommand();
         frameSetup.addFrameParameters(frameData);
-        double[] signal=h2s.manchesterCoding(frameData);
-        return signal;
+        return frameData;
     }
 
-    public double[] generateSignal(int data[])
+    // erase frames have no data part, the bootloader stops listening after the header
+    // (with error correction the frame is sent at full length, the check bits come last)
+    public int[] makeEraseFrame(int firstPage, int pages)
+    {
+        int[] frameData=new int[fecFlag ? frameSetup.getFrameSize() : frameSetup.getPageStart()];
+        frameSetup.setEraseCommand();
+        frameSetup.setPageIndex(firstPage);
+        frameSetup.setTotalLength(pages);
+        frameSetup.addFrameParameters(frameData);
+        return frameData;
+    }
+
+    private void addEraseFrame(int firstPage, int pages)
+    {
+        double duration=Math.max(frameSetup.getSilenceBetweenPages(),pages*frameSetup.getSilencePerErasedPage());
+        addFrame(makeEraseFrame(firstPage,pages),duration);
+    }
+
+    public int[] makeChipEraseFrame()
+    {
+        int[] frameData=new int[fecFlag ? frameSetup.getFrameSize() : frameSetup.getPageStart()];
+        frameSetup.setChipEraseCommand();
+        frameSetup.setPageIndex(0);
+        frameSetup.setTotalLength(0);
+        frameSetup.addFrameParameters(frameData);
+        return frameData;
+    }
+
+    private void addChipEraseFrame()
+    {
+        addFrame(makeChipEraseFrame(),frameSetup.getChipErasePages()*frameSetup.getSilencePerErasedPage());
+    }
+
+    // silence after a page frame, page 0 is always erased and written
+    private double pageSilence(int page)
+    {
+        if(chipEraseFlag && page>0) return frameSetup.getSilenceBetweenWrittenPages();
+        return frameSetup.getSilenceBetweenPages();
+    }
+
+    private boolean isErasedPage(int page[])
+    {
+        for(int n=0;n<page.length;n++) if(page[n]!=0xFF) return false;
+        return true;
+    }
+
+    public void addProgFrames(int data[])
     {
-        double[] signal=new double[1];
-        frameSetup.setProgCommand(); // we want to programm the mc
         int pl=frameSetup.getPageSize();
         int total=data.length;
         int sigPointer=0;
         int pagePointer=0;
+        int erasedPages=0;
 
 
         while(total>0)
         {
-            frameSetup.setPageIndex(pagePointer++);
-            frameSetup.setTotalLength(data.length);
-
             int[] partSig=new int[pl];
 
             for(int n=0;n<pl;n++)
@@ -114,15 +339,133 @@ public class WavCodeGenerator
             }
 
             sigPointer+=pl;
-            double[] sig=generatePageSignal(partSig);
-            signal=appendSignal(signal,sig);
+            total-=pl;
 
-            signal=appendSignal(signal,silence(frameSetup.getSilenceBetweenPages()));
+            // runs of empty pages are sent as one erase frame, page 0 always holds the reset vector
+            // after a chip erase they are left out
+            if(pagePointer>0 && isErasedPage(partSig))
+            {
+                if(!chipEraseFlag) erasedPages++;
+                pagePointer++;
+                continue;
+            }
+            if(erasedPages>0)
+            {
+                addEraseFrame(pagePointer-erasedPages,erasedPages);
+                erasedPages=0;
+            }
 
-            total-=pl;
+            frameSetup.setProgCommand(); // we want to programm the mc
+            frameSetup.setPageIndex(pagePointer);
+            frameSetup.setTotalLength(data.length);
+
+            addFrame(makePageFrame(partSig),pageSilence(pagePointer++));
+        }
+        if(erasedPages>0)
+        {
+            addEraseFrame(pagePointer-erasedPages,erasedPages);
+        }
+    }
+
+    public void addCompressedFrames(int data[])
+    {
+        LzssCompressor lzss=new LzssCompressor(data);
+        frameSetup.setLzssCommand();
+        int pl=frameSetup.getPageSize();
+        int group=0;
+        int expanded=0;
+        int frameIndex=0;
+
+        while(group<lzss.getNumberOfGroups())
+        {
+            int[] partSig=new int[pl];
+            int length=0;
+            int pagesBefore=expanded/pl;
+
+            // fill the frame with whole groups
+            while(group<lzss.getNumberOfGroups() && length+lzss.getGroup(group).length<=pl)
+            {
+                int[] g=lzss.getGroup(group);
+                for(int n=0;n<g.length;n++) partSig[length++]=g[n];
+                expanded+=lzss.getExpandedLength(group);
+                group++;
+            }
+
+            frameSetup.setPageIndex(frameIndex++);
+            frameSetup.setTotalLength(length);
+
+            // the bootloader programs every page this frame completed before listening again
+            double duration=0;
+            for(int page=pagesBefore;page<expanded/pl;page++) duration+=pageSilence(page);
+            addFrame(makePageFrame(partSig),Math.max(duration,frameSetup.getSilenceBetweenPages()));
         }
+        System.out.println("LZSS: "+data.length+" bytes compressed into "+frameIndex+" frames");
+    }
+
+    // eeprom: image from address 0, -1 marks bytes the file doesn't set.
+    // A frame always starts at the beginning of its page: pages without any set byte are
+    // left alone, but unset bytes in front of the last set byte of a page are written as 0xFF.
+    public void addEepromFrames(int eeprom[])
+    {
+        int pl=frameSetup.getPageSize();
+
+        frameSetup.setEepromCommand();
+        for(int page=0;page*pl<eeprom.length;page++)
+        {
+            int[] partSig=new int[pl];
+            int length=0;
+            double duration=0;
+
+            for(int n=0;n<pl && page*pl+n<eeprom.length;n++)
+            {
+                int value=eeprom[page*pl+n];
+                partSig[n]=(value<0) ? 0xFF : value;
+                if(value>=0) length=n+1;
+            }
+            if(length==0) continue;
+
+            // unchanged bytes are skipped on the device, but only 0xFF is known to be quick
+            for(int n=0;n<length;n++)
+            {
+                if(partSig[n]==0xFF) duration+=frameSetup.getSilencePerErasedEepromByte();
+                else                 duration+=frameSetup.getSilencePerEepromByte();
+            }
+
+            frameSetup.setPageIndex(page);
+            frameSetup.setTotalLength(length);
+            // the bootloader writes the bytes while it receives the next frame
+            addFrame(makePageFrame(partSig),duration,true);
+        }
+    }
+
+    public double[] generateSignal(int data[])
+    {
+        return generateSignal(data,null);
+    }
+
+    // flash and EEPROM in one go, eeprom may be null
+    public double[] generateSignal(int data[], int eeprom[])
+    {
+        clearFrames();
+
+        if(chipEraseFlag) addChipEraseFrame();
+        if(compressFlag) addCompressedFrames(data);
+        else             addProgFrames(data);
+        if(eeprom!=null) addEepromFrames(eeprom);
+        addFrame(makeRunFrame(),0); // send mc "start the application"
 
-        signal=appendSignal(signal,makeRunCommand()); // send mc "start the application"
+        double[] signal;
+        if(rateCodes==null) signal=encodeFrames(0);
+        else
+        {
+            signal=new double[1];
+            for(int n=0;n<rateCodes.length;n++)
+            {
+                // the gap lets the units that skip this pass find the next one
+                signal=appendSignal(signal,encodeFrames(rateCodes[n]));
+                signal=appendSignal(signal,silence(frameSetup.getSilenceBetweenPages()));
+            }
+        }
         // added silence at sound end to time out sound fading in some wav players like from Mircosoft
         for(int k=0;k<10;k++)
         {
@@ -183,12 +526,23 @@ public class WavCodeGenerator
     }
 
     public boolean convertHex2Wav(File hexFile, File wavFile) throws Exception
+    {
+        return convertHex2Wav(hexFile, null, wavFile);
+    }
+
+    // eepFile: EEPROM contents in Intel hex format ( *.eep ), may be null
+    public boolean convertHex2Wav(File hexFile, File eepFile, File wavFile) throws Exception
     {
         //IntelHexFormat ih=new IntelHexFormat();
         byte[] erg = IntelHexFormat.IntelHexFormatToByteArray(hexFile);
         IntelHexFormat.anzeigen(erg);
+        int[] eeprom = null;
+        if (eepFile != null)
+        {
+            eeprom = IntelHexFormat.toUnsignedIntImage(IntelHexFormat.IntelHexFormatToByteArray(eepFile));
+        }
         //WavCodeGenerator w=new WavCodeGenerator();
-        double[] signal=generateSignal(IntelHexFormat.toUnsignedIntArray(IntelHexFormat.discardHeaderBytes(erg)));
+        double[] signal=generateSignal(IntelHexFormat.toUnsignedIntArray(IntelHexFormat.discardHeaderBytes(erg)),eeprom);
         saveWav(signal,wavFile);
         return true;
     }
@@ -198,23 +552,105 @@ public class WavCodeGenerator
         String inFileName;
         String outFileName;
 
-        if (args.length < 1)
+        WavCodeGenerator wcg = new WavCodeGenerator();
+        File eepFile = null;
+        int argn = 0;
+
+        while (argn < args.length && args[argn].startsWith("-"))
+        {
+            String option = args[argn++];
+
+            if (option.equals("-c"))
+            {
+                wcg.setCompression(true);
+            }
+            else if (option.equals("-f"))
+            {
+                wcg.setErrorCorrection(true);
+            }
+            else if (option.equals("-i") && argn < args.length)
+            {
+                wcg.setInterleaveDepth(Integer.parseInt(args[argn++]));
+            }
+            else if (option.equals("-s") && argn < args.length)
+            {
+                double spb = Double.parseDouble(args[argn++]);
+                if (spb < 3 || spb > 5 || spb * 2 != Math.rint(spb * 2))
+                {
+                    System.err.println("Samples per bit have to be 3 to 5 in steps of 0.5");
+                    System.exit(1);
+                }
+                wcg.setSamplesPerBit(spb);
+            }
+            else if (option.equals("-r") && argn < args.length)
+            {
+                String[] list = args[argn++].split(",");
+                double[] spb = new double[list.length];
+                for (int n = 0; n < list.length; n++)
+                {
+                    spb[n] = Double.parseDouble(list[n]);
+                    if (spb[n] < 3 || spb[n] > 5 || spb[n] * 2 != Math.rint(spb[n] * 2))
+                    {
+                        System.err.println("Rates have to be 3 to 5 samples per bit in steps of 0.5");
+                        System.exit(1);
+                    }
+                }
+                wcg.setRatePasses(spb);
+            }
+            else if (option.equals("-p"))
+            {
+                wcg.setPamCoding(true);
+            }
+            else if (option.equals("-m"))
+            {
+                wcg.setMillerCoding(true);
+            }
+            else if (option.equals("-x"))
+            {
+                wcg.setChipErase(true);
+            }
+            else if (option.equals("-e") && argn < args.length)
+            {
+                eepFile = new File(args[argn++]);
+            }
+            else
+            {
+                System.err.println("Unknown option " + option);
+                System.exit(1);
+            }
+        }
+
+        if (wcg.rateCodes != null && (wcg.pamFlag || wcg.millerFlag))
+        {
+            System.err.println("Rate passes (-r) are only sent in manchester code");
+            System.exit(1);
+        }
+
+        if (args.length - argn < 1)
         {
-            System.err.println("Usage: hex2wav <infile.hex> <outfile.wav>");
+            System.err.println("Usage: hex2wav [-c] [-f] [-i depth] [-s samples] [-r s1,s2..] [-p] [-m] [-x] [-e eeprom.eep] <infile.hex> <outfile.wav>");
+            System.err.println("    -c  LZSS compressed program frames (bootloader built with COMPRESS=1)");
+            System.err.println("    -f  forward error correction (bootloader built with FEC=1)");
+            System.err.println("    -i  interleave the bits of 'depth' frames, implies -f (bootloader built with FEC=1 INTERLEAVE=depth)");
+            System.err.println("    -s  manchester samples per bit, 3 to 5 in steps of 0.5 (default 4)");
+            System.err.println("    -r  the upload once per rate in samples per bit, each unit takes the fastest it can (bootloader built with RATEFIELD=1)");
+            System.err.println("    -p  4 level symbols, twice the speed (bootloader built with ADCSLICER=1 PAM=1)");
+            System.err.println("    -m  Miller code, twice the speed (bootloader built with MILLER=1)");
+            System.err.println("    -x  erase the whole flash first, then the pages are only written");
+            System.err.println("    -e  write the EEPROM contents from an Intel hex file too");
             System.exit(1);
         }
-        inFileName = args[0];
-        outFileName = (args.length == 2) ? args[1] : inFileName + ".wav";
+        inFileName = args[argn];
+        outFileName = (args.length - argn == 2) ? args[argn + 1] : inFileName + ".wav";
 
         System.out.println("Converting " + inFileName + " to " + outFileName);
 
         File inFile  = new File(inFileName);
         File outFile = new File(outFileName);
 
-        WavCodeGenerator wcg = new WavCodeGenerator();
-        wcg.convertHex2Wav(inFile, outFile);
+        wcg.convertHex2Wav(inFile, eepFile, outFile);
         System.out.println("\n\nDone conversion");
-        if (args.length < 2)
+        if (args.length - argn < 2)
         {
             System.out.println("Playing WAV file…");
             new AePlayWave(outFileName).start();